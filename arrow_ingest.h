@@ -0,0 +1,231 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "relative_error_quantiles_sketch.h"
+
+// Arrow C Data Interface, verbatim from
+// https://arrow.apache.org/docs/format/CDataInterface.html so that no Arrow
+// library is needed to hand arrays to the sketch.
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+  // Array type description
+  const char *format;
+  const char *name;
+  const char *metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema **children;
+  struct ArrowSchema *dictionary;
+
+  // Release callback
+  void (*release)(struct ArrowSchema *);
+  // Opaque producer-specific data
+  void *private_data;
+};
+
+struct ArrowArray {
+  // Array data description
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void **buffers;
+  struct ArrowArray **children;
+  struct ArrowArray *dictionary;
+
+  // Release callback
+  void (*release)(struct ArrowArray *);
+  // Opaque producer-specific data
+  void *private_data;
+};
+
+#endif // ARROW_C_DATA_INTERFACE
+
+inline bool ArrowBitIsSet(const uint8_t *bitmap, const int64_t i) {
+  return (bitmap[i >> 3] >> (i & 7)) & 1;
+}
+
+// Calls function(begin, end) for each maximal run of valid (non-null) slots
+// in [0, length) of an array whose validity bitmap starts at bit offset.
+// Whole bytes of nulls or of valid slots are skipped at once.
+template <typename Function>
+void ForEachValidRun(const uint8_t *bitmap, const int64_t offset,
+                     const int64_t length, Function &&function) {
+  if (bitmap == nullptr) {
+    if (length > 0) {
+      function(int64_t{0}, length);
+    }
+    return;
+  }
+
+  auto skip = [&](int64_t i, const bool valid) -> int64_t {
+    const uint8_t whole_byte = valid ? 0xFF : 0x00;
+    while (i < length && ArrowBitIsSet(bitmap, offset + i) == valid) {
+      const int64_t bit = offset + i;
+      if ((bit & 7) == 0 && i + 8 <= length &&
+          bitmap[bit >> 3] == whole_byte) {
+        i += 8;
+      } else {
+        ++i;
+      }
+    }
+    return i;
+  };
+
+  int64_t i = 0;
+  while (i < length) {
+    const int64_t begin = skip(i, false);
+    i = skip(begin, true);
+    if (begin < i) {
+      function(begin, i);
+    }
+  }
+}
+
+// Random access iterator over the values of a utf8 / large utf8 array as
+// std::string_view, pointing straight into the array's data buffer.
+template <typename Offset> class ArrowStringIterator {
+public:
+  using iterator_category = std::random_access_iterator_tag;
+  using value_type = std::string_view;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const std::string_view *;
+  using reference = std::string_view;
+
+  ArrowStringIterator(const Offset *offsets, const char *data, int64_t i)
+      : offsets_(offsets), data_(data), i_(i) {}
+
+  std::string_view operator*() const {
+    return std::string_view(data_ + offsets_[i_],
+                            offsets_[i_ + 1] - offsets_[i_]);
+  }
+  std::string_view operator[](difference_type n) const { return *(*this + n); }
+
+  ArrowStringIterator &operator++() {
+    ++i_;
+    return *this;
+  }
+  ArrowStringIterator operator++(int) {
+    ArrowStringIterator copy = *this;
+    ++i_;
+    return copy;
+  }
+  ArrowStringIterator &operator--() {
+    --i_;
+    return *this;
+  }
+  ArrowStringIterator &operator+=(difference_type n) {
+    i_ += n;
+    return *this;
+  }
+  ArrowStringIterator operator+(difference_type n) const {
+    return ArrowStringIterator(offsets_, data_, i_ + n);
+  }
+  ArrowStringIterator operator-(difference_type n) const {
+    return ArrowStringIterator(offsets_, data_, i_ - n);
+  }
+  difference_type operator-(const ArrowStringIterator &other) const {
+    return i_ - other.i_;
+  }
+  bool operator==(const ArrowStringIterator &other) const {
+    return i_ == other.i_;
+  }
+  bool operator!=(const ArrowStringIterator &other) const {
+    return i_ != other.i_;
+  }
+  bool operator<(const ArrowStringIterator &other) const {
+    return i_ < other.i_;
+  }
+
+private:
+  const Offset *offsets_;
+  const char *data_;
+  int64_t i_;
+};
+
+template <typename Value, typename T>
+void InsertArrowNumeric(RelativeErrorQuantilesSketch<T> &sketch,
+                        const ArrowArray &array) {
+  // Converting would silently truncate (double to int64) or wrap (int64 to
+  // uint64), so the sketch's key type must be the array's value type.
+  if constexpr (!std::is_same_v<Value, T>) {
+    throw std::invalid_argument("Arrow value type does not match the sketch "
+                                "key type");
+  } else {
+    const auto *validity = static_cast<const uint8_t *>(array.buffers[0]);
+    const auto *values =
+        static_cast<const Value *>(array.buffers[1]) + array.offset;
+    ForEachValidRun(array.null_count == 0 ? nullptr : validity, array.offset,
+                    array.length, [&](int64_t begin, int64_t end) {
+                      sketch.InsertBatch(values + begin, values + end);
+                    });
+  }
+}
+
+template <typename Offset, typename T>
+void InsertArrowStrings(RelativeErrorQuantilesSketch<T> &sketch,
+                        const ArrowArray &array) {
+  if constexpr (!std::is_constructible_v<T, std::string_view>) {
+    throw std::invalid_argument("utf8 Arrow array for a non-string sketch");
+  } else {
+    const auto *validity = static_cast<const uint8_t *>(array.buffers[0]);
+    const auto *offsets =
+        static_cast<const Offset *>(array.buffers[1]) + array.offset;
+    const auto *data = static_cast<const char *>(array.buffers[2]);
+    ForEachValidRun(array.null_count == 0 ? nullptr : validity, array.offset,
+                    array.length, [&](int64_t begin, int64_t end) {
+                      sketch.InsertBatch(
+                          ArrowStringIterator<Offset>(offsets, data, begin),
+                          ArrowStringIterator<Offset>(offsets, data, end));
+                    });
+  }
+}
+
+// Inserts the non-null values of an Arrow array into the sketch at level 0.
+// Supported formats are int64 ("l"), double ("g"), utf8 ("u") and large utf8
+// ("U"). Numeric values are read straight out of the array's buffers and
+// strings are constructed in the sketch's buffers from views into the data
+// buffer, so nothing is staged in an intermediate vector. The caller keeps
+// ownership of array and schema; neither release callback is invoked.
+// Numeric arrays need a sketch of exactly their value type (int64_t or
+// double). Throws std::invalid_argument for other formats or mismatched
+// sketch types.
+template <typename T>
+void InsertArrowArray(RelativeErrorQuantilesSketch<T> &sketch,
+                      const ArrowArray &array, const ArrowSchema &schema) {
+  if (schema.dictionary != nullptr || array.dictionary != nullptr) {
+    throw std::invalid_argument("dictionary encoded Arrow arrays are not "
+                                "supported");
+  }
+  if (array.length == 0) {
+    return;
+  }
+
+  const std::string_view format(schema.format);
+  if (format == "l") {
+    InsertArrowNumeric<int64_t>(sketch, array);
+  } else if (format == "g") {
+    InsertArrowNumeric<double>(sketch, array);
+  } else if (format == "u") {
+    InsertArrowStrings<int32_t>(sketch, array);
+  } else if (format == "U") {
+    InsertArrowStrings<int64_t>(sketch, array);
+  } else {
+    throw std::invalid_argument("unsupported Arrow format \"" +
+                                std::string(format) + "\"");
+  }
+}
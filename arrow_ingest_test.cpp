@@ -0,0 +1,127 @@
+#include "arrow_ingest.h"
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+ArrowSchema Schema(const char *format) {
+  return ArrowSchema{.format = format,
+                     .name = "",
+                     .metadata = nullptr,
+                     .flags = ARROW_FLAG_NULLABLE,
+                     .n_children = 0,
+                     .children = nullptr,
+                     .dictionary = nullptr,
+                     .release = nullptr,
+                     .private_data = nullptr};
+}
+
+ArrowArray Array(int64_t length, int64_t null_count, int64_t offset,
+                 int64_t n_buffers, const void **buffers) {
+  return ArrowArray{.length = length,
+                    .null_count = null_count,
+                    .offset = offset,
+                    .n_buffers = n_buffers,
+                    .n_children = 0,
+                    .buffers = buffers,
+                    .children = nullptr,
+                    .dictionary = nullptr,
+                    .release = nullptr,
+                    .private_data = nullptr};
+}
+
+RelativeErrorQuantilesSketchOptions Options() {
+  return RelativeErrorQuantilesSketchOptions{.n = 1 << 16, .k = 64};
+}
+
+TEST(ArrowIngestTest, ValidRuns) {
+  // Bits 0-2 valid, 3-4 null, 5-20 valid, 21 null, 22-23 valid.
+  const uint8_t bitmap[] = {0b11100111, 0b11111111, 0b11011111};
+  std::vector<std::pair<int64_t, int64_t>> runs;
+  ForEachValidRun(bitmap, 0, 24, [&](int64_t begin, int64_t end) {
+    runs.emplace_back(begin, end);
+  });
+  ASSERT_EQ(runs, (std::vector<std::pair<int64_t, int64_t>>{
+                      {0, 3}, {5, 21}, {22, 24}}));
+
+  // The same bitmap seen through an offset of 4.
+  runs.clear();
+  ForEachValidRun(bitmap, 4, 20, [&](int64_t begin, int64_t end) {
+    runs.emplace_back(begin, end);
+  });
+  ASSERT_EQ(runs, (std::vector<std::pair<int64_t, int64_t>>{{1, 17},
+                                                            {18, 20}}));
+}
+
+TEST(ArrowIngestTest, Int64WithNulls) {
+  const std::vector<int64_t> values = {100, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  // Slot 0 is skipped through the offset; slots 3 and 6 (values 3 and 6)
+  // are null.
+  const uint8_t bitmap[] = {0b10110110, 0b00000011};
+  const void *buffers[] = {bitmap, values.data()};
+  const ArrowArray array = Array(9, 2, 1, 2, buffers);
+  const ArrowSchema schema = Schema("l");
+
+  RelativeErrorQuantilesSketch<int64_t> sketch(Options());
+  InsertArrowArray(sketch, array, schema);
+  sketch.Close();
+  ASSERT_EQ(sketch.Items(), (std::vector<int64_t>{1, 2, 4, 5, 7, 8, 9}));
+}
+
+TEST(ArrowIngestTest, DoubleWithoutValidityBitmap) {
+  const std::vector<double> values = {2.5, 0.5, 1.5};
+  const void *buffers[] = {nullptr, values.data()};
+  const ArrowArray array = Array(3, 0, 0, 2, buffers);
+  const ArrowSchema schema = Schema("g");
+
+  RelativeErrorQuantilesSketchOptions options = Options();
+  options.staging_size = 2;
+  RelativeErrorQuantilesSketch<double> sketch(options);
+  InsertArrowArray(sketch, array, schema);
+  sketch.Close();
+  ASSERT_EQ(sketch.Items(), (std::vector<double>{0.5, 1.5, 2.5}));
+}
+
+TEST(ArrowIngestTest, Utf8) {
+  const std::string data = "pearapplefig";
+  const std::vector<int32_t> offsets = {0, 4, 9, 9, 12};
+  const uint8_t bitmap[] = {0b00001011};
+  const void *buffers[] = {bitmap, offsets.data(), data.data()};
+  const ArrowArray array = Array(4, 1, 0, 3, buffers);
+  const ArrowSchema schema = Schema("u");
+
+  RelativeErrorQuantilesSketch<std::string> sketch(Options());
+  InsertArrowArray(sketch, array, schema);
+  sketch.Close();
+  ASSERT_EQ(sketch.Items(),
+            (std::vector<std::string>{"apple", "fig", "pear"}));
+}
+
+TEST(ArrowIngestTest, UnsupportedFormat) {
+  const std::vector<int32_t> values = {1, 2, 3};
+  const void *buffers[] = {nullptr, values.data()};
+  const ArrowArray array = Array(3, 0, 0, 2, buffers);
+  const ArrowSchema schema = Schema("i");
+
+  RelativeErrorQuantilesSketch<int64_t> sketch(Options());
+  ASSERT_THROW(InsertArrowArray(sketch, array, schema), std::invalid_argument);
+}
+
+TEST(ArrowIngestTest, MismatchedValueType) {
+  const std::vector<double> doubles = {0.5, 1.5};
+  const void *double_buffers[] = {nullptr, doubles.data()};
+  const ArrowArray double_array = Array(2, 0, 0, 2, double_buffers);
+  RelativeErrorQuantilesSketch<int64_t> int64_sketch(Options());
+  ASSERT_THROW(InsertArrowArray(int64_sketch, double_array, Schema("g")),
+               std::invalid_argument);
+
+  const std::vector<int64_t> int64s = {-1, 1};
+  const void *int64_buffers[] = {nullptr, int64s.data()};
+  const ArrowArray int64_array = Array(2, 0, 0, 2, int64_buffers);
+  RelativeErrorQuantilesSketch<uint64_t> uint64_sketch(Options());
+  ASSERT_THROW(InsertArrowArray(uint64_sketch, int64_array, Schema("l")),
+               std::invalid_argument);
+  RelativeErrorQuantilesSketch<int> int_sketch(Options());
+  ASSERT_THROW(InsertArrowArray(int_sketch, int64_array, Schema("l")),
+               std::invalid_argument);
+}
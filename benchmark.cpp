@@ -0,0 +1,861 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <fmt/core.h>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "column_file_ingest.h"
+#include "concurrent_sketch.h"
+#include "csv_column_ingest.h"
+#include "distribution_distance.h"
+#include "exact_quantile_oracle.h"
+#include "gzip_ingest.h"
+#include "inline_string.h"
+#include "relative_error_quantiles_sketch.h"
+#include "workload_file.h"
+
+// Small driver for comparing sketch configurations. Each case is selected by
+// name on the command line, e.g. `streaming-quantiles-benchmark sizing`;
+// any further arguments are passed to the case.
+
+std::vector<uint64_t> UniformKeys(uint64_t count) {
+  std::mt19937_64 gen(42);
+  std::vector<uint64_t> keys(count);
+  for (auto &key : keys) {
+    key = gen();
+  }
+  return keys;
+}
+
+template <typename Function> double Seconds(Function &&function) {
+  const auto start = std::chrono::steady_clock::now();
+  function();
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+void BenchmarkSizing(const std::vector<std::string> &) {
+  const uint64_t count = 20'000'000;
+  const std::vector<uint64_t> keys = UniformKeys(count);
+
+  struct Config {
+    const char *name;
+    BufferSizing sizing;
+    uint64_t level0_k_multiplier;
+  };
+  const std::vector<Config> configs = {
+      {"uniform", BufferSizing::kUniform, 1},
+      {"level-scaled", BufferSizing::kLevelScaled, 1},
+      {"level-scaled, 4x level 0", BufferSizing::kLevelScaled, 4},
+  };
+
+  std::vector<std::string> results;
+  for (const Config &config : configs) {
+    RelativeErrorQuantilesSketchOptions options = {
+        .n = count,
+        .k = 256,
+        .sizing = config.sizing,
+        .level0_k_multiplier = config.level0_k_multiplier};
+    RelativeErrorQuantilesSketch<uint64_t> sketch(options);
+    const double seconds = Seconds([&] {
+      for (const uint64_t key : keys) {
+        sketch.Insert(key, 0);
+      }
+    });
+    results.push_back(fmt::format(
+        "{:<26} {:>8.1f} Minserts/s  H {:>2}  retained {:>7}  capacity "
+        "{:>7} items ({:.1f} KiB)",
+        config.name, count / seconds / 1e6, sketch.Depth(),
+        sketch.RetainedItems(), sketch.BufferCapacity(),
+        sketch.BufferCapacity() * sizeof(uint64_t) / 1024.0));
+  }
+  for (const auto &result : results) {
+    fmt::print("{}\n", result);
+  }
+}
+
+void BenchmarkStaging(const std::vector<std::string> &) {
+  const uint64_t count = 20'000'000;
+  const std::vector<uint64_t> keys = UniformKeys(count);
+
+  std::vector<std::string> results;
+  for (const uint64_t staging_size : {0, 16, 64, 256}) {
+    RelativeErrorQuantilesSketchOptions options = {
+        .n = count, .k = 256, .staging_size = staging_size};
+    RelativeErrorQuantilesSketch<uint64_t> sketch(options);
+    const double seconds = Seconds([&] {
+      for (const uint64_t key : keys) {
+        sketch.Insert(key, 0);
+      }
+    });
+    results.push_back(fmt::format("staging size {:>3} {:>8.1f} Minserts/s",
+                                  staging_size, count / seconds / 1e6));
+  }
+  for (const auto &result : results) {
+    fmt::print("{}\n", result);
+  }
+}
+
+void BenchmarkExtract(const std::vector<std::string> &) {
+  // Roughly one level-0 buffer worth of items at k = 16384.
+  const uint64_t count = 1 << 19;
+  const int repetitions = 2000;
+  std::vector<uint64_t> items = UniformKeys(count);
+  std::vector<uint64_t> out(count / 2);
+
+  const double kernel_seconds = Seconds([&] {
+    for (int r = 0; r < repetitions; ++r) {
+      ExtractAlternate(items.data(), count, out.data());
+    }
+  });
+  const double push_back_seconds = Seconds([&] {
+    for (int r = 0; r < repetitions; ++r) {
+      out.clear();
+      for (uint64_t i = 0; i < count; i += 2) {
+        out.push_back(items[i]);
+      }
+    }
+  });
+  fmt::print("ExtractAlternate {:>8.2f} Gitems/s\n",
+             count * repetitions / kernel_seconds / 1e9);
+  fmt::print("push_back loop   {:>8.2f} Gitems/s\n",
+             count * repetitions / push_back_seconds / 1e9);
+}
+
+void BenchmarkSearch(const std::vector<std::string> &) {
+  std::mt19937_64 gen(42);
+  for (const uint64_t count : {100'000, 1'000'000, 10'000'000}) {
+    // Power of two weights, as in a closed sketch's view.
+    std::vector<double> weights(count);
+    for (auto &weight : weights) {
+      weight = static_cast<double>(1 << (gen() % 12));
+    }
+
+    std::vector<double> scalar = weights;
+    const double scalar_seconds = Seconds([&] {
+      std::partial_sum(scalar.begin(), scalar.end(), scalar.begin());
+    });
+    std::vector<double> cumulative = weights;
+    const double prefix_seconds =
+        Seconds([&] { PrefixSum(cumulative.data(), cumulative.size()); });
+
+    const uint64_t lookups = 2'000'000;
+    std::vector<double> targets(lookups);
+    for (auto &target : targets) {
+      target = std::uniform_real_distribution<double>(
+          0.0, cumulative.back())(gen);
+    }
+    uint64_t checksum = 0;
+    const double std_seconds = Seconds([&] {
+      for (const double target : targets) {
+        checksum += std::lower_bound(cumulative.begin(), cumulative.end(),
+                                     target) -
+                    cumulative.begin();
+      }
+    });
+    const double branchless_seconds = Seconds([&] {
+      for (const double target : targets) {
+        checksum += BranchlessLowerBound(cumulative.data(), cumulative.size(),
+                                         target);
+      }
+    });
+
+    fmt::print("{:>9} entries: partial_sum {:>6.2f} ns/entry, PrefixSum "
+               "{:>6.2f} ns/entry\n",
+               count, scalar_seconds / count * 1e9,
+               prefix_seconds / count * 1e9);
+    fmt::print("{:>9} entries: std::lower_bound {:>6.1f} ns/lookup, "
+               "BranchlessLowerBound {:>6.1f} ns/lookup (checksum {})\n",
+               count, std_seconds / lookups * 1e9,
+               branchless_seconds / lookups * 1e9, checksum);
+  }
+}
+
+// Rank lookups in sorted keys of a few shapes: binary search against
+// interpolation search.
+void BenchmarkInterpolation(const std::vector<std::string> &) {
+  const uint64_t count = 1'000'000;
+  const uint64_t lookups = 2'000'000;
+  std::mt19937_64 gen(42);
+  std::lognormal_distribution<double> lognormal(8.0, 1.5);
+  const std::vector<std::pair<std::string, std::function<double(uint64_t)>>>
+      shapes = {
+          {"uniform", [&](uint64_t) {
+             return std::uniform_real_distribution<double>(0.0, 1e9)(gen);
+           }},
+          {"lognormal", [&](uint64_t) { return lognormal(gen); }},
+          // Exponential spacing: every interpolation guess lands near the
+          // low end.
+          {"adversarial", [&](const uint64_t i) {
+             return std::pow(1.0 + 1e-4, static_cast<double>(i));
+           }},
+      };
+  for (const auto &[name, shape] : shapes) {
+    std::vector<double> keys(count);
+    for (uint64_t i = 0; i < count; ++i) {
+      keys[i] = shape(i);
+    }
+    std::sort(keys.begin(), keys.end());
+    // Probes are drawn from the keys themselves, as rank queries usually
+    // are, nudged so about half are not exact matches.
+    std::vector<double> probes(lookups);
+    for (auto &probe : probes) {
+      probe = keys[gen() % count] * (gen() % 2 == 0 ? 1.0 : 1.0 + 1e-9);
+    }
+    uint64_t checksum = 0;
+    const double std_seconds = Seconds([&] {
+      for (const double probe : probes) {
+        checksum +=
+            std::lower_bound(keys.begin(), keys.end(), probe) - keys.begin();
+      }
+    });
+    const double branchless_seconds = Seconds([&] {
+      for (const double probe : probes) {
+        checksum -= BranchlessLowerBound(keys.data(), count, probe);
+      }
+    });
+    const double interpolation_seconds = Seconds([&] {
+      for (const double probe : probes) {
+        checksum += InterpolationLowerBound(keys.data(), count, probe);
+      }
+    });
+    fmt::print("{:<12} std::lower_bound {:>6.1f} ns, BranchlessLowerBound "
+               "{:>6.1f} ns, InterpolationLowerBound {:>6.1f} ns per lookup "
+               "(checksum {})\n",
+               name, std_seconds / lookups * 1e9,
+               branchless_seconds / lookups * 1e9,
+               interpolation_seconds / lookups * 1e9, checksum);
+  }
+}
+
+void BenchmarkConcurrent(const std::vector<std::string> &) {
+  const uint64_t count = 8'000'000;
+  const std::vector<uint64_t> keys = UniformKeys(count);
+  RelativeErrorQuantilesSketchOptions options = {
+      .n = count, .k = 1024, .staging_size = 64};
+  std::vector<std::string> results;
+  for (const uint64_t threads : {1, 4, 16}) {
+    auto run = [&](auto &&insert) {
+      std::vector<std::thread> writers;
+      for (uint64_t t = 0; t < threads; ++t) {
+        writers.emplace_back([&, t] {
+          for (uint64_t i = t; i < count; i += threads) {
+            insert(t, keys[i]);
+          }
+        });
+      }
+      for (auto &writer : writers) {
+        writer.join();
+      }
+    };
+
+    ConcurrentSketch<uint64_t> shared(options);
+    const double shared_seconds = Seconds(
+        [&] { run([&](uint64_t, uint64_t key) { shared.Insert(key); }); });
+    shared.Flush();
+    const uint64_t shared_bytes =
+        shared.Sketch().MemoryUsage().total_bytes + shared.RingBytes();
+
+    std::vector<RelativeErrorQuantilesSketch<uint64_t>> local(
+        threads, RelativeErrorQuantilesSketch<uint64_t>(options));
+    const double local_seconds = Seconds([&] {
+      run([&](uint64_t t, uint64_t key) { local[t].Insert(key, 0); });
+    });
+    uint64_t local_bytes = 0;
+    for (const auto &sketch : local) {
+      local_bytes += sketch.MemoryUsage().total_bytes;
+    }
+    results.push_back(fmt::format(
+        "{:>2} threads: shared {:>6.2f} Minserts/s {:>7.0f} KiB, "
+        "per-thread {:>6.2f} Minserts/s {:>7.0f} KiB",
+        threads, count / shared_seconds / 1e6, shared_bytes / 1024.0,
+        count / local_seconds / 1e6, local_bytes / 1024.0));
+  }
+  for (const auto &result : results) {
+    fmt::print("{}\n", result);
+  }
+}
+
+void BenchmarkMerge(const std::vector<std::string> &) {
+  const uint64_t count = 2'000'000;
+  const std::vector<uint64_t> keys = UniformKeys(2 * count);
+  RelativeErrorQuantilesSketchOptions options = {
+      .n = 2 * count, .k = 1024, .staging_size = 64};
+  RelativeErrorQuantilesSketch<std::string> left(options);
+  RelativeErrorQuantilesSketch<std::string> right(options);
+  for (uint64_t i = 0; i < count; ++i) {
+    left.Insert(fmt::format("{:016x}{:016x}", keys[i], i), 0);
+    right.Insert(fmt::format("{:016x}{:016x}", keys[count + i], i), 0);
+  }
+  std::vector<std::string> results;
+  for (const unsigned threads : {0u, 1u, 2u, 4u}) {
+    RelativeErrorQuantilesSketch<std::string> merged = left;
+    double seconds = 0.0;
+    if (threads == 0) {
+      seconds = Seconds([&] { merged.Merge(right); });
+    } else {
+      ThreadPool pool(threads);
+      seconds = Seconds([&] { merged.Merge(right, pool); });
+    }
+    results.push_back(fmt::format(
+        "{:<18} {:>8.2f} ms, {} levels, {} compactions",
+        threads == 0 ? std::string("sequential")
+                     : fmt::format("{} pool threads", threads),
+        seconds * 1e3, merged.Depth() + 1, merged.Compactions()));
+  }
+  for (const auto &result : results) {
+    fmt::print("{}\n", result);
+  }
+}
+
+void BenchmarkLiveQuantile(const std::vector<std::string> &) {
+  const uint64_t count = 10'000'000;
+  const std::vector<uint64_t> keys = UniformKeys(count);
+  RelativeErrorQuantilesSketchOptions options = {
+      .n = count, .k = 1024, .staging_size = 64};
+  RelativeErrorQuantilesSketch<uint64_t> sketch(options);
+  sketch.InsertBatch(keys.begin(), keys.end());
+  RelativeErrorQuantilesSketch<uint64_t> closed = sketch;
+  uint64_t closed_p99 = 0;
+  const double closed_seconds = Seconds([&] {
+    closed.Close();
+    closed_p99 = closed.GetQuantile(0.99);
+  });
+  uint64_t live_p99 = 0;
+  const double live_seconds =
+      Seconds([&] { live_p99 = sketch.GetLiveQuantile(0.99); });
+  fmt::print("p99 of {} retained items: Close + GetQuantile {:.2f} ms, "
+             "GetLiveQuantile {:.2f} ms, same answer: {}\n",
+             sketch.RetainedItems(), closed_seconds * 1e3, live_seconds * 1e3,
+             closed_p99 == live_p99);
+
+  // Point ranks: the first query merges each level's sorted runs into one,
+  // later ones only search.
+  const uint64_t queries = 100'000;
+  double rank_sum = 0.0;
+  const double first_seconds =
+      Seconds([&] { rank_sum += sketch.EstimateLiveRank(keys[0]); });
+  const double rank_seconds = Seconds([&] {
+    for (uint64_t i = 0; i < queries; ++i) {
+      rank_sum += sketch.EstimateLiveRank(keys[i]);
+    }
+  });
+  fmt::print("rank queries: first {:.2f} ms, then {:.0f} ns each "
+             "(checksum {})\n",
+             first_seconds * 1e3, rank_seconds / queries * 1e9, rank_sum);
+}
+
+// Quantile lookups on a closed string sketch, copying each result or
+// referencing it in the view.
+void BenchmarkQuantileRefs(const std::vector<std::string> &) {
+  const uint64_t count = 2'000'000;
+  const std::vector<uint64_t> keys = UniformKeys(count);
+  RelativeErrorQuantilesSketchOptions options = {
+      .n = count, .k = 1024, .staging_size = 64};
+  RelativeErrorQuantilesSketch<std::string> sketch(options);
+  for (uint64_t i = 0; i < count; ++i) {
+    sketch.Insert(fmt::format("{:016x}{:016x}", keys[i], i), 0);
+  }
+  sketch.Close();
+  const uint64_t polls = 10'000;
+  const int n = 100;
+  uint64_t checksum = 0;
+  const double copy_seconds = Seconds([&] {
+    for (uint64_t poll = 0; poll < polls; ++poll) {
+      for (int q = 1; q <= n; ++q) {
+        checksum += sketch.GetQuantile(static_cast<double>(q) / n).size();
+      }
+    }
+  });
+  using QuantileRef = RelativeErrorQuantilesSketch<std::string>::QuantileRef;
+  std::vector<QuantileRef> refs;
+  const double ref_seconds = Seconds([&] {
+    for (uint64_t poll = 0; poll < polls; ++poll) {
+      sketch.QuantileRefs(n, refs);
+      for (const QuantileRef &ref : refs) {
+        checksum += ref.item->size();
+      }
+    }
+  });
+  fmt::print("{} quantiles of {} items: GetQuantile copies {:.1f} us, "
+             "QuantileRefs {:.1f} us (checksum {})\n",
+             n, sketch.Items().size(), copy_seconds / polls * 1e6,
+             ref_seconds / polls * 1e6, checksum);
+}
+
+// Exact answers for a stream that the oracle must spill to disk, and the
+// sketch's error measured against them.
+void BenchmarkOracle(const std::vector<std::string> &) {
+  const uint64_t count = 50'000'000;
+  const std::vector<uint64_t> keys = UniformKeys(count);
+  ExactQuantileOracle<uint64_t> oracle({.memory_bytes = 64 << 20});
+  const double add_seconds = Seconds([&] {
+    oracle.Add(keys.begin(), keys.end());
+    oracle.Finish();
+  });
+  const std::vector<double> ranks = {0.01, 0.5, 0.9, 0.99, 0.999};
+  std::vector<uint64_t> exact;
+  const double query_seconds =
+      Seconds([&] { exact = oracle.Quantiles(ranks); });
+
+  RelativeErrorQuantilesSketchOptions options = {
+      .n = count, .k = 1024, .staging_size = 64};
+  RelativeErrorQuantilesSketch<uint64_t> sketch(options);
+  sketch.InsertBatch(keys.begin(), keys.end());
+  sketch.Close();
+  std::vector<uint64_t> estimates;
+  for (const double rank : ranks) {
+    estimates.push_back(sketch.GetQuantile(rank));
+  }
+  const std::vector<uint64_t> estimate_ranks = oracle.Ranks(estimates);
+
+  fmt::print("{} keys in {} runs: sorted to disk at {:.1f} Mkeys/s, one "
+             "query pass {:.2f} s\n",
+             count, oracle.Runs(), count / add_seconds / 1e6, query_seconds);
+  for (uint64_t i = 0; i < ranks.size(); ++i) {
+    const double true_rank = static_cast<double>(estimate_ranks[i]) / count;
+    fmt::print("  rank {:<6} exact {:>20} sketch {:>20} (true rank {:.5f})\n",
+               ranks[i], exact[i], estimates[i], true_rank);
+  }
+}
+
+// Export of a closed view as a few representative points.
+void BenchmarkDownsample(const std::vector<std::string> &) {
+  const uint64_t count = 10'000'000;
+  const std::vector<uint64_t> keys = UniformKeys(count);
+  RelativeErrorQuantilesSketchOptions options = {
+      .n = count, .k = 1024, .staging_size = 64};
+  RelativeErrorQuantilesSketch<uint64_t> sketch(options);
+  sketch.InsertBatch(keys.begin(), keys.end());
+  sketch.Close();
+  const auto &items = sketch.Items();
+  const auto &cumulative_weights = sketch.CumulativeWeights();
+  std::vector<std::string> results;
+  for (const uint64_t m : {100, 1000, 10000}) {
+    std::vector<RelativeErrorQuantilesSketch<uint64_t>::WeightedElement> points;
+    const double seconds = Seconds([&] { points = sketch.Downsample(m); });
+    // Largest rank error over the view's items, as a fraction of the total.
+    double max_error = 0.0;
+    double rank = 0.0;
+    uint64_t p = 0;
+    for (uint64_t i = 0; i < items.size(); ++i) {
+      while (p < points.size() && points[p].item < items[i]) {
+        rank += points[p++].weight;
+      }
+      const double view_rank = i == 0 ? 0.0 : cumulative_weights[i - 1];
+      max_error = std::max(max_error, std::abs(rank - view_rank));
+    }
+    results.push_back(fmt::format(
+        "{} -> {} points in {:.2f} ms, {} KiB -> {} KiB, max rank error "
+        "{:.4f}%",
+        items.size(), points.size(), seconds * 1e3,
+        items.size() * (sizeof(uint64_t) + sizeof(double)) / 1024,
+        points.size() * sizeof(points[0]) / 1024,
+        100.0 * max_error / sketch.TotalWeight()));
+  }
+  for (const auto &result : results) {
+    fmt::print("{}\n", result);
+  }
+}
+
+// Dashboard-style polling: the same p50/p99 and CDF splits asked for again
+// and again while the sketch is idle, with and without the query cache.
+void BenchmarkQueryCache(const std::vector<std::string> &) {
+  const uint64_t count = 10'000'000;
+  const std::vector<uint64_t> keys = UniformKeys(count);
+  std::vector<uint64_t> splits(100);
+  for (uint64_t i = 0; i < splits.size(); ++i) {
+    splits[i] = (UINT64_MAX / splits.size()) * i;
+  }
+  const uint64_t polls = 1000;
+  std::vector<std::string> results;
+  for (const uint64_t cache_size : {0, 8}) {
+    RelativeErrorQuantilesSketchOptions options = {.n = count,
+                                                   .k = 1024,
+                                                   .staging_size = 64,
+                                                   .query_cache_size =
+                                                       cache_size};
+    RelativeErrorQuantilesSketch<uint64_t> sketch(options);
+    sketch.InsertBatch(keys.begin(), keys.end());
+    uint64_t checksum = 0;
+    const double seconds = Seconds([&] {
+      for (uint64_t i = 0; i < polls; ++i) {
+        checksum += sketch.GetLiveQuantile(0.5);
+        checksum += sketch.GetLiveQuantile(0.99);
+        checksum += static_cast<uint64_t>(sketch.LiveCdf(splits)[50] * 100);
+      }
+    });
+    results.push_back(fmt::format(
+        "cache size {}: {:.1f} us per poll (checksum {})", cache_size,
+        seconds / polls * 1e6, checksum));
+  }
+  for (const auto &result : results) {
+    fmt::print("{}\n", result);
+  }
+}
+
+void BenchmarkDistance(const std::vector<std::string> &) {
+  const uint64_t count = 1'000'000;
+  const std::vector<uint64_t> keys = UniformKeys(2 * count);
+  RelativeErrorQuantilesSketchOptions options = {.n = count, .k = 64};
+  RelativeErrorQuantilesSketch<uint64_t> sketch(options);
+  RelativeErrorQuantilesSketch<uint64_t> baseline(options);
+  for (uint64_t i = 0; i < count; ++i) {
+    sketch.Insert(keys[i], 0);
+    baseline.Insert(keys[count + i], 0);
+  }
+  sketch.Close();
+  baseline.Close();
+
+  const int pairs = 1000;
+  double ks = 0.0;
+  const double seconds = Seconds([&] {
+    for (int p = 0; p < pairs; ++p) {
+      ks += ComputeDistributionDistance(sketch, baseline).kolmogorov_smirnov;
+    }
+  });
+  fmt::print("{} pairs of {} + {} item views: {:.2f} ms total, {:.1f} us/pair "
+             "(KS {:.4f})\n",
+             pairs, sketch.Items().size(), baseline.Items().size(),
+             seconds * 1e3, seconds / pairs * 1e6, ks / pairs);
+}
+
+void BenchmarkColumnFile(const std::vector<std::string> &) {
+  const uint64_t count = 40'000'000;
+  const std::string path = "/tmp/streaming-quantiles-column.bin";
+  {
+    const std::vector<uint64_t> keys = UniformKeys(count);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(keys.data()),
+              keys.size() * sizeof(uint64_t));
+  }
+
+  RelativeErrorQuantilesSketchOptions options = {
+      .n = count, .k = 256, .staging_size = 64};
+  std::vector<std::string> results;
+  for (const unsigned threads : {1u, 2u, 4u}) {
+    const double seconds = Seconds([&] {
+      auto sketch = IngestColumnFile<uint64_t>(path, options,
+                                               {.threads = threads});
+      sketch.Close();
+    });
+    results.push_back(fmt::format(
+        "IngestColumnFile, {} threads {:>8.1f} Minserts/s {:>6.0f} MB/s",
+        threads, count / seconds / 1e6, count * 8 / seconds / 1e6));
+  }
+  const double insert_seconds = Seconds([&] {
+    const MappedFile file(path);
+    const auto *values = reinterpret_cast<const uint64_t *>(file.data());
+    RelativeErrorQuantilesSketch<uint64_t> sketch(options);
+    for (uint64_t i = 0; i < count; ++i) {
+      sketch.Insert(values[i], 0);
+    }
+    sketch.Close();
+  });
+  results.push_back(fmt::format("Insert() loop              {:>8.1f} "
+                                "Minserts/s {:>6.0f} MB/s",
+                                count / insert_seconds / 1e6,
+                                count * 8 / insert_seconds / 1e6));
+  for (const auto &result : results) {
+    fmt::print("{}\n", result);
+  }
+  std::remove(path.c_str());
+}
+
+void BenchmarkCsv(const std::vector<std::string> &) {
+  const std::string path = "/tmp/streaming-quantiles-column.csv";
+  uint64_t bytes = 0;
+  {
+    std::mt19937_64 gen(42);
+    std::lognormal_distribution<double> latency(3.0, 1.0);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << "timestamp,host,path,status,bytes,region,zone,latency_ms\n";
+    std::string line;
+    for (uint64_t i = 0; i < 5'000'000; ++i) {
+      line = fmt::format("{},host-{},/api/v1/items/{},200,{},us-east-1,b,"
+                         "{:.3f}\n",
+                         1700000000 + i, gen() % 64, gen() % 100000,
+                         gen() % 65536, latency(gen));
+      out << line;
+      bytes += line.size();
+    }
+  }
+
+  RelativeErrorQuantilesSketchOptions options = {
+      .n = 5'000'000, .k = 256, .staging_size = 64};
+  RelativeErrorQuantilesSketch<double> latencies(options);
+  CsvIngestResult result;
+  const double seconds = Seconds([&] {
+    result = IngestCsvColumn(path, latencies, {.column = 7, .header = true});
+  });
+  latencies.Close();
+  fmt::print("latency_ms: {} lines, {} errors, {:.0f} MB/s, p99 {:.1f}\n",
+             result.lines_inserted, result.parse_errors,
+             bytes / seconds / 1e6, latencies.GetQuantile(0.99));
+
+  uint64_t fields = 0;
+  const double scan_seconds = Seconds([&] {
+    const MappedFile file(path);
+    ForEachCsvField(file.data(), file.data() + file.size(), ',', 7,
+                    [&](std::string_view) { ++fields; });
+  });
+  fmt::print("field scan only: {} fields, {:.0f} MB/s\n", fields,
+             bytes / scan_seconds / 1e6);
+  std::remove(path.c_str());
+}
+
+void BenchmarkGzip(const std::vector<std::string> &) {
+  std::mt19937_64 gen(42);
+  std::vector<std::string> paths;
+  for (int f = 0; f < 4; ++f) {
+    const std::string path =
+        fmt::format("/tmp/streaming-quantiles-keys-{}.gz", f);
+    gzFile out = gzopen(path.c_str(), "wb6");
+    for (int i = 0; i < 500'000; ++i) {
+      const std::string line =
+          fmt::format("{:016x}:{:016x}:{:016x}:{:016x}:{:016x}\n", gen(),
+                      gen(), gen(), gen(), gen());
+      gzwrite(out, line.data(), line.size());
+    }
+    gzclose(out);
+    paths.push_back(path);
+  }
+
+  RelativeErrorQuantilesSketchOptions options = {
+      .n = 2'000'000, .k = 256, .staging_size = 64};
+  for (const unsigned threads : {1u, 2u}) {
+    RelativeErrorQuantilesSketch<std::string> sketch(options);
+    GzipIngestResult result;
+    const double seconds = Seconds([&] {
+      result = IngestKeyFiles(
+          paths, sketch,
+          {.decompress_threads = threads, .ingest_threads = threads});
+    });
+    fmt::print("{} + {} threads: {} keys, {:.0f} MB/s decompressed, {:.2f} "
+               "Mkeys/s\n",
+               threads, threads, result.keys_inserted,
+               result.decompressed_bytes / seconds / 1e6,
+               result.keys_inserted / seconds / 1e6);
+  }
+  for (const auto &path : paths) {
+    std::remove(path.c_str());
+  }
+}
+
+template <typename T>
+void ReplayConfigurations(const WorkloadReplayer &replayer) {
+  const uint64_t n = replayer.RecordCount();
+  for (const uint32_t k : {64u, 256u, 1024u}) {
+    for (const uint64_t staging : {0ul, 64ul}) {
+      RelativeErrorQuantilesSketchOptions options = {
+          .n = n, .k = k, .staging_size = staging};
+      RelativeErrorQuantilesSketch<T> sketch(options);
+      const double seconds = Seconds([&] { replayer.Replay(sketch); });
+      fmt::print("k {:>4}, staging {:>2}: {:>7.2f} Mkeys/s, {} retained\n", k,
+                 staging, n / seconds / 1e6, sketch.RetainedItems());
+    }
+  }
+}
+
+template <typename T>
+double StringKeySeconds(const std::vector<std::string_view> &keys) {
+  RelativeErrorQuantilesSketchOptions options = {
+      .n = keys.size(), .k = 256, .staging_size = 64};
+  RelativeErrorQuantilesSketch<T> sketch(options);
+  return Seconds([&] {
+    sketch.InsertBatch(keys.begin(), keys.end());
+    sketch.Close();
+  });
+}
+
+void BenchmarkInlineString(const std::vector<std::string> &) {
+  const uint64_t count = 5'000'000;
+  std::mt19937_64 gen(42);
+  for (const uint64_t length : {16, 24, 40}) {
+    std::string arena(count * length, '\0');
+    std::vector<std::string_view> keys(count);
+    for (uint64_t i = 0; i < count; ++i) {
+      const std::string key = fmt::format("{:016x}{:016x}{:016x}", gen(),
+                                          gen(), gen());
+      std::memcpy(arena.data() + i * length, key.data(), length);
+      keys[i] = std::string_view(arena.data() + i * length, length);
+    }
+    const double string_seconds = StringKeySeconds<std::string>(keys);
+    const double inline_seconds = StringKeySeconds<InlineString<47>>(keys);
+    fmt::print("{}-byte keys: std::string {:.2f} Minserts/s, InlineString<47> "
+               "{:.2f} Minserts/s\n",
+               length, count / string_seconds / 1e6,
+               count / inline_seconds / 1e6);
+  }
+
+  // URL-like keys of about 200 bytes, sketched on a 32-byte prefix.
+  std::vector<std::string> urls(count);
+  for (auto &url : urls) {
+    url = fmt::format("https://cdn.example.com/{:016x}/assets/{:0>160}",
+                      gen() % 100'000, gen());
+  }
+  const std::vector<std::string_view> keys(urls.begin(), urls.end());
+  const double string_seconds = StringKeySeconds<std::string>(keys);
+  const double prefix_seconds = StringKeySeconds<TruncatedPrefixKey<32>>(keys);
+  fmt::print("{}-byte URLs: std::string {:.2f} Minserts/s, "
+             "TruncatedPrefixKey<32> {:.2f} Minserts/s\n",
+             urls[0].size(), count / string_seconds / 1e6,
+             count / prefix_seconds / 1e6);
+}
+
+// Bytes held by levels 1 and up, unpacked or packed.
+template <typename T>
+uint64_t UpperLevelBytes(const RelativeErrorQuantilesSketch<T> &sketch) {
+  uint64_t bytes = 0;
+  for (uint64_t h = 1; h < sketch.Compactors().size(); ++h) {
+    const Compactor<T> &compactor = sketch.Compactors()[h];
+    bytes += compactor.is_packed ? compactor.packed.PackedBytes()
+                                 : compactor.buffer.size() * sizeof(T);
+  }
+  return bytes;
+}
+
+void BenchmarkPacking(const std::vector<std::string> &) {
+  const uint64_t count = 20'000'000;
+  std::mt19937_64 gen(42);
+  std::vector<uint64_t> timestamps(count);
+  uint64_t now = 1'700'000'000'000'000'000;
+  for (auto &timestamp : timestamps) {
+    now += gen() % 2'000'000;
+    timestamp = now;
+  }
+  std::lognormal_distribution<double> lognormal(8.0, 1.5);
+  std::vector<uint64_t> latencies(count);
+  for (auto &latency : latencies) {
+    latency = static_cast<uint64_t>(lognormal(gen));
+  }
+  const std::vector<uint64_t> uniform = UniformKeys(count);
+
+  RelativeErrorQuantilesSketchOptions options = {
+      .n = count, .k = 256, .staging_size = 64};
+  std::vector<std::string> results;
+  for (const auto &[name, keys] :
+       {std::pair{"timestamps (ns)", &std::as_const(timestamps)},
+        std::pair{"latencies (us)", &std::as_const(latencies)},
+        std::pair{"uniform", &uniform}}) {
+    RelativeErrorQuantilesSketch<uint64_t> sketch(options);
+    sketch.InsertBatch(keys->begin(), keys->end());
+    RelativeErrorQuantilesSketch<uint64_t> packed = sketch;
+    const uint64_t unpacked_bytes = UpperLevelBytes(sketch);
+    const double pack_seconds = Seconds([&] { packed.Pack(); });
+    const uint64_t packed_bytes = UpperLevelBytes(packed);
+    const double close_seconds = Seconds([&] { sketch.Close(); });
+    const double packed_close_seconds = Seconds([&] { packed.Close(); });
+    results.push_back(fmt::format(
+        "{:<16} levels 1+: {:>8} -> {:>8} bytes ({:.2f}x), pack {:.2f} ms, "
+        "Close() {:.2f} -> {:.2f} ms",
+        name, unpacked_bytes, packed_bytes,
+        static_cast<double>(unpacked_bytes) / packed_bytes, pack_seconds * 1e3,
+        close_seconds * 1e3, packed_close_seconds * 1e3));
+  }
+  for (const auto &result : results) {
+    fmt::print("{}\n", result);
+  }
+}
+
+// Replays a capture (argument 1) into a range of sketch configurations. With
+// no argument, records synthetic captures in the formats main.cpp generates
+// and replays those.
+void BenchmarkReplay(const std::vector<std::string> &args) {
+  std::vector<std::string> paths = args;
+  if (paths.empty()) {
+    std::mt19937_64 gen(42);
+    const std::string keys_path = "/tmp/streaming-quantiles-keys.sqk";
+    std::vector<std::string> keys(2'000'000);
+    const double format_seconds = Seconds([&] {
+      for (auto &key : keys) {
+        key = fmt::format("{:016x}:{:016x}:{:016x}:{:016x}:{:016x}", gen(),
+                          gen(), gen(), gen(), gen());
+      }
+    });
+    {
+      WorkloadRecorder recorder(keys_path, {});
+      for (const auto &key : keys) {
+        recorder.Record(key);
+      }
+    }
+    fmt::print("generating keys with fmt::format: {:.2f} Mkeys/s\n",
+               keys.size() / format_seconds / 1e6);
+
+    const std::string values_path = "/tmp/streaming-quantiles-values.sqk";
+    {
+      WorkloadRecorder recorder(values_path,
+                                {.key_type = WorkloadKeyType::kUint64,
+                                 .fixed_width = sizeof(uint64_t)});
+      for (const uint64_t value : UniformKeys(20'000'000)) {
+        recorder.RecordValue(value);
+      }
+    }
+    paths = {keys_path, values_path};
+  }
+
+  for (const auto &path : paths) {
+    const WorkloadReplayer replayer(path);
+    fmt::print("{}: {} records\n", path, replayer.RecordCount());
+    switch (replayer.KeyType()) {
+    case WorkloadKeyType::kBytes:
+      ReplayConfigurations<std::string>(replayer);
+      break;
+    case WorkloadKeyType::kUint64:
+      ReplayConfigurations<uint64_t>(replayer);
+      break;
+    case WorkloadKeyType::kInt64:
+      ReplayConfigurations<int64_t>(replayer);
+      break;
+    case WorkloadKeyType::kDouble:
+      ReplayConfigurations<double>(replayer);
+      break;
+    }
+    if (args.empty()) {
+      std::remove(path.c_str());
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  using Benchmark = std::function<void(const std::vector<std::string> &)>;
+  const std::map<std::string, Benchmark> benchmarks = {
+      {"cache", BenchmarkQueryCache},
+      {"column", BenchmarkColumnFile},
+      {"concurrent", BenchmarkConcurrent},
+      {"csv", BenchmarkCsv},
+      {"distance", BenchmarkDistance},
+      {"downsample", BenchmarkDownsample},
+      {"extract", BenchmarkExtract},
+      {"gzip", BenchmarkGzip},
+      {"inline", BenchmarkInlineString},
+      {"interpolation", BenchmarkInterpolation},
+      {"live", BenchmarkLiveQuantile},
+      {"merge", BenchmarkMerge},
+      {"oracle", BenchmarkOracle},
+      {"packing", BenchmarkPacking},
+      {"quantiles", BenchmarkQuantileRefs},
+      {"replay", BenchmarkReplay},
+      {"search", BenchmarkSearch},
+      {"sizing", BenchmarkSizing},
+      {"staging", BenchmarkStaging},
+  };
+
+  if (argc < 2 || benchmarks.count(argv[1]) == 0) {
+    fmt::print("Usage: {} <benchmark> [arguments]\nBenchmarks:\n", argv[0]);
+    for (const auto &[name, function] : benchmarks) {
+      fmt::print("  {}\n", name);
+    }
+    return 1;
+  }
+  benchmarks.at(argv[1])(std::vector<std::string>(argv + 2, argv + argc));
+  return 0;
+}
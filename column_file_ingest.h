@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include "mapped_file.h"
+#include "relative_error_quantiles_sketch.h"
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "column files are read as little-endian in place");
+
+struct ColumnIngestOptions {
+  // Number of ingest threads, each filling its own sketch. 0 means one per
+  // hardware thread.
+  unsigned threads = 0;
+  // Threads claim the file in windows of this many bytes. Must be a
+  // multiple of 2 MiB so windows line up with huge pages.
+  uint64_t window_bytes = 64 << 20;
+};
+
+// Sketches a file holding a raw little-endian array of T (int64_t, double,
+// ...). The file is mapped once with MADV_SEQUENTIAL; threads claim
+// consecutive windows from a shared counter, insert each window with one
+// InsertBatch() straight out of the mapping, and drop the window's pages
+// once done so resident memory stays bounded. The per-thread sketches are
+// merged into the returned one. Throws std::system_error if the file cannot
+// be mapped and std::invalid_argument if its size is not a multiple of
+// sizeof(T). An exception on any thread stops the others and is rethrown
+// once all have finished.
+template <typename T>
+RelativeErrorQuantilesSketch<T>
+IngestColumnFile(const std::string &path,
+                 const RelativeErrorQuantilesSketchOptions &options,
+                 const ColumnIngestOptions &ingest = ColumnIngestOptions()) {
+  static_assert(std::is_arithmetic_v<T>, "column files hold numeric values");
+  constexpr uint64_t kHugePageSize = 2 << 20;
+  if (ingest.window_bytes == 0 || ingest.window_bytes % kHugePageSize != 0) {
+    throw std::invalid_argument("window_bytes must be a multiple of 2 MiB");
+  }
+
+  const MappedFile file(path);
+  if (file.size() % sizeof(T) != 0) {
+    throw std::invalid_argument(path + " is not a whole number of values");
+  }
+  file.Advise(0, file.size(), MADV_SEQUENTIAL);
+
+  const uint64_t windows =
+      (file.size() + ingest.window_bytes - 1) / ingest.window_bytes;
+  const unsigned threads = static_cast<unsigned>(std::min<uint64_t>(
+      std::max<uint64_t>(windows, 1),
+      ingest.threads > 0 ? ingest.threads
+                         : std::max(1u, std::thread::hardware_concurrency())));
+
+  std::vector<RelativeErrorQuantilesSketch<T>> sketches(
+      threads, RelativeErrorQuantilesSketch<T>(options));
+  std::atomic<uint64_t> next_window{0};
+  auto ingest_windows = [&](RelativeErrorQuantilesSketch<T> &sketch) {
+    for (uint64_t window = next_window.fetch_add(1); window < windows;
+         window = next_window.fetch_add(1)) {
+      const uint64_t offset = window * ingest.window_bytes;
+      const uint64_t length =
+          std::min(ingest.window_bytes, file.size() - offset);
+      file.Advise(offset, length, MADV_HUGEPAGE);
+      const T *first = reinterpret_cast<const T *>(file.data() + offset);
+      sketch.InsertBatch(first, first + length / sizeof(T));
+      file.Advise(offset, length, MADV_DONTNEED);
+    }
+  };
+
+  // The first exception any thread hits is kept; claiming every remaining
+  // window stops the other threads after the window they are on.
+  std::mutex error_mutex;
+  std::exception_ptr error;
+  auto fail = [&](std::exception_ptr e) {
+    next_window = windows;
+    std::lock_guard<std::mutex> lock(error_mutex);
+    if (!error) {
+      error = e;
+    }
+  };
+  auto guarded_ingest_windows = [&](RelativeErrorQuantilesSketch<T> &sketch) {
+    try {
+      ingest_windows(sketch);
+    } catch (...) {
+      fail(std::current_exception());
+    }
+  };
+
+  std::vector<std::thread> workers;
+  try {
+    for (unsigned t = 1; t < threads; ++t) {
+      workers.emplace_back(guarded_ingest_windows, std::ref(sketches[t]));
+    }
+  } catch (...) {
+    fail(std::current_exception());
+  }
+  guarded_ingest_windows(sketches[0]);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+
+  for (unsigned t = 1; t < threads; ++t) {
+    sketches[0].Merge(sketches[t]);
+  }
+  return std::move(sketches[0]);
+}
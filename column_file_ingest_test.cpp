@@ -0,0 +1,43 @@
+#include "column_file_ingest.h"
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+std::string WriteColumnFile(const std::vector<int64_t> &values) {
+  const std::string path =
+      ::testing::TempDir() + "column_file_ingest_test.bin";
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char *>(values.data()),
+            values.size() * sizeof(int64_t));
+  return path;
+}
+
+TEST(ColumnFileIngestTest, IngestsEveryValueAcrossThreads) {
+  // 8 MiB of values: four 2 MiB windows shared by three threads.
+  std::vector<int64_t> values(1 << 20);
+  for (size_t i = 0; i < values.size(); ++i) {
+    values[i] = static_cast<int64_t>((i * 7919) % values.size());
+  }
+  const std::string path = WriteColumnFile(values);
+
+  RelativeErrorQuantilesSketchOptions options = {.n = 1 << 20, .k = 64};
+  ColumnIngestOptions ingest = {.threads = 3, .window_bytes = 2 << 20};
+  auto sketch = IngestColumnFile<int64_t>(path, options, ingest);
+  sketch.Close();
+  ASSERT_EQ(sketch.TotalWeight(), values.size());
+  // Small ranks are the most accurate end of the sketch.
+  ASSERT_NEAR(sketch.EstimateRank(1000), 1000, 10);
+  std::remove(path.c_str());
+}
+
+TEST(ColumnFileIngestTest, RejectsPartialValues) {
+  const std::string path = ::testing::TempDir() + "column_file_partial.bin";
+  std::ofstream(path, std::ios::binary | std::ios::trunc) << "123";
+  RelativeErrorQuantilesSketchOptions options = {.n = 1 << 20, .k = 64};
+  ASSERT_THROW(IngestColumnFile<int64_t>(path, options),
+               std::invalid_argument);
+  std::remove(path.c_str());
+}
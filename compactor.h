@@ -6,92 +6,358 @@
 #include <cstdint>
 #include <fmt/core.h>
 #include <functional>
+#include <iterator>
 #include <random>
 #include <vector>
 
-bool RandomBoolean() {
-  static std::mt19937 generator;
-  static std::random_device rd;
-  generator.seed(rd());
+#include "kernels.h"
+#include "memory_usage.h"
+#include "packed_level.h"
+
+// Sketches may compact on several threads at once (e.g. one sketch per
+// ingest thread), so each thread gets its own generator, seeded once.
+inline std::mt19937 &RandomBooleanGenerator() {
+  thread_local std::mt19937 generator(std::random_device{}());
+  return generator;
+}
+
+inline bool RandomBoolean() {
   std::bernoulli_distribution distribution(0.5);
-  return distribution(generator);
+  return distribution(RandomBooleanGenerator());
+}
+
+// Reseeds the calling thread's generator, making the compactions that
+// follow on this thread reproducible (e.g. for seeded test trials).
+inline void SeedRandomBoolean(const uint64_t seed) {
+  std::seed_seq sequence{static_cast<uint32_t>(seed),
+                         static_cast<uint32_t>(seed >> 32)};
+  RandomBooleanGenerator().seed(sequence);
 }
 
 template <typename T> struct Compactor {
   uint64_t n;               // Number of sections for compaction
   uint64_t k;               // Section size
+  uint64_t m;               // Number of sections in the buffer
   uint64_t max_buffer_size; // Max buffer size
   uint64_t C;               // Compaction schedule
   uint64_t h;               // Position in the compaction hierarchy
   std::vector<T> buffer;    // Items
+  // While the buffer has only received sorted runs, run_ends holds the end
+  // offset of each run so compaction can merge rather than sort.
+  bool sorted_runs = true;
+  std::vector<uint64_t> run_ends;
+  // Set by Pack(): the items live, sorted, in packed and buffer is empty.
+  // Every mutation unpacks first.
+  bool is_packed = false;
+  PackedSortedLevel<T> packed;
+  // Heap bytes owned by the items in buffer (see HeapBytes), kept up to
+  // date on every append and compaction.
+  uint64_t payload_bytes = 0;
 
   Compactor(uint64_t k, uint64_t n, uint64_t h) : n(n), k(k), C(0), h(h) {
-    const uint64_t m =
-        std::ceil(std::log(static_cast<double>(n) / static_cast<double>(k)) /
-                  std::log(2));
+    // Streams shorter than 2k (e.g. the top levels of a level scaled sketch)
+    // still need one section to compact.
+    m = std::max<int64_t>(
+        1, std::ceil(std::log(static_cast<double>(n) / static_cast<double>(k)) /
+                     std::log(2)));
     max_buffer_size = 2 * k * m;
     fmt::print("{}: Creating compactor with buffer size {}\n", h,
                max_buffer_size);
   }
 
   std::vector<T> Insert(const T &element) {
+    Unpack();
     std::vector<T> output;
     if (buffer.size() == max_buffer_size) {
-      int sections_to_compact = 0;
-      uint64_t c = C;
-      while ((c & 1) == 1) {
-        sections_to_compact++;
-        c >>= 1;
+      Compact(output);
+    }
+
+    // Now that we're done compaction (if necessary) we can add the element to
+    // the buffer. A single item breaks up any sorted runs we were tracking.
+    buffer.push_back(element);
+    AddPayload(buffer.size() - 1);
+    sorted_runs = false;
+    run_ends.clear();
+    return output;
+  };
+
+  // Appends the sorted items [first, last) as a run, compacting whenever the
+  // buffer fills up exactly as if they had been inserted one at a time.
+  // Promoted items are appended to output. As long as the buffer only ever
+  // receives runs, compaction merges them instead of sorting the buffer.
+  void InsertRun(const T *first, const T *last, std::vector<T> &output) {
+    Unpack();
+    while (first != last) {
+      if (buffer.size() == max_buffer_size) {
+        Compact(output);
+      }
+      const uint64_t count = std::min<uint64_t>(
+          last - first, max_buffer_size - buffer.size());
+      // Runs that continue where the previous one ended are coalesced.
+      const bool extends_run = sorted_runs && !run_ends.empty() &&
+                               !buffer.empty() && !(*first < buffer.back());
+      buffer.insert(buffer.end(), first, first + count);
+      AddPayload(buffer.size() - count);
+      if (extends_run) {
+        run_ends.back() = buffer.size();
+      } else if (sorted_runs) {
+        run_ends.push_back(buffer.size());
+      }
+      first += count;
+    }
+  }
+
+  // Appends the unordered items [first, last), compacting whenever the buffer
+  // fills up exactly as if they had been inserted one at a time. Items are
+  // constructed in the buffer from whatever the iterators yield.
+  template <typename Iterator>
+  void InsertBatch(Iterator first, Iterator last, std::vector<T> &output) {
+    Unpack();
+    while (first != last) {
+      if (buffer.size() == max_buffer_size) {
+        Compact(output);
       }
+      const uint64_t count = std::min<uint64_t>(
+          last - first, max_buffer_size - buffer.size());
+      buffer.insert(buffer.end(), first, first + count);
+      AddPayload(buffer.size() - count);
+      sorted_runs = false;
+      run_ends.clear();
+      first += count;
+    }
+  }
+
+  // Appends [first, last), which is made of a few ascending runs such as the
+  // output of one or more compactions, as one InsertRun per run.
+  void InsertRuns(const T *first, const T *last, std::vector<T> &output) {
+    while (first != last) {
+      const T *run_end = std::is_sorted_until(first, last);
+      InsertRun(first, run_end, output);
+      first = run_end;
+    }
+  }
+
+  void Compact(std::vector<T> &output) {
+    int sections_to_compact = 0;
+    uint64_t c = C;
+    while ((c & 1) == 1) {
       sections_to_compact++;
-      const uint64_t elements_to_compact = sections_to_compact * k;
+      c >>= 1;
+    }
+    sections_to_compact++;
+    // If n was underestimated the schedule can outgrow the buffer; never
+    // compact more than the sections we have.
+    sections_to_compact = std::min<uint64_t>(sections_to_compact, m);
+    const uint64_t elements_to_compact = sections_to_compact * k;
 
-      // Put the largest elements to compact at the back of the buffer by
-      // figuring out where to pivot the buffer. See example at
-      // https://en.cppreference.com/w/cpp/algorithm/partial_sort.html
-      const uint64_t S = max_buffer_size - elements_to_compact;
+    // Put the largest elements to compact at the back of the buffer by
+    // figuring out where to pivot the buffer. See example at
+    // https://en.cppreference.com/w/cpp/algorithm/partial_sort.html
+    // A buffer made of sorted runs is merged instead, which leaves the whole
+    // buffer sorted.
+    const uint64_t S = max_buffer_size - elements_to_compact;
+    if (sorted_runs) {
+      MergeRuns();
+    } else {
       std::partial_sort(buffer.rbegin(), buffer.rbegin() + S, buffer.rend(),
                         std::greater{});
+    }
 
-      // Take even or odd indexes for compacted sections to add to the output
-      // for pushing to the next compactor, then drop the compacted sections.
-      bool even = RandomBoolean();
-      uint64_t i = S;
-      if (!even && i % 2 == 0) {
-        ++i;
+    // Everything from S on leaves the buffer, promoted or dropped.
+    if constexpr (HeapBytes<T>::kAllocates) {
+      for (uint64_t j = S; j < max_buffer_size; ++j) {
+        payload_bytes -= HeapBytes<T>::Of(buffer[j]);
       }
-      while (i < max_buffer_size) {
-        output.push_back(buffer[i]);
-        i += 2;
+    }
+
+    // Take even or odd indexes for compacted sections to add to the output
+    // for pushing to the next compactor, then drop the compacted sections.
+    bool even = RandomBoolean();
+    uint64_t i = S;
+    if (!even && i % 2 == 0) {
+      ++i;
+    }
+    // The compacted items are dropped right after, so they are moved rather
+    // than copied into the preallocated tail of output.
+    const uint64_t survivors = (max_buffer_size - i + 1) / 2;
+    const uint64_t offset = output.size();
+    output.resize(offset + survivors);
+    ExtractAlternate(buffer.data() + i, max_buffer_size - i,
+                     output.data() + offset);
+
+    // Clear elements after element S
+    const uint64_t target_capacity = max_buffer_size - elements_to_compact;
+    buffer.resize(target_capacity);
+
+    // Resize the vector down so that we don't have extra memory growth.
+    // Post "compaction" we should have max_buffer_size/2 elements in the
+    // buffer and it should start growing again.
+    buffer.shrink_to_fit();
+    assert(buffer.size() == target_capacity);
+    assert(buffer.capacity() == target_capacity);
+    if (sorted_runs) {
+      run_ends.assign(1, target_capacity);
+    }
+
+    // Update the compactor schedule so we can "randomly" choose new
+    // sections next time.
+    ++C;
+  }
+
+  // Merges the runs in run_ends into one sorted run. After a compaction the
+  // buffer is one long retained run followed by short new ones, so adjacent
+  // runs are merged smallest pair first and the long run is only moved once.
+  void MergeRuns() {
+    std::vector<T> scratch;
+    while (run_ends.size() > 1) {
+      size_t best = 0;
+      uint64_t best_size = UINT64_MAX;
+      for (size_t r = 0; r + 1 < run_ends.size(); ++r) {
+        const uint64_t begin = r == 0 ? 0 : run_ends[r - 1];
+        if (run_ends[r + 1] - begin < best_size) {
+          best_size = run_ends[r + 1] - begin;
+          best = r;
+        }
       }
+      MergeAdjacent(best == 0 ? 0 : run_ends[best - 1], run_ends[best],
+                    run_ends[best + 1], scratch);
+      run_ends.erase(run_ends.begin() + best);
+    }
+  }
 
-      // Clear elements after element S
-      const uint64_t target_capacity = max_buffer_size - elements_to_compact;
-      buffer.resize(target_capacity);
+  // Merges the sorted ranges [begin, middle) and [middle, end) of the buffer
+  // in place, buffering only the shorter of the two in scratch.
+  void MergeAdjacent(const uint64_t begin, const uint64_t middle,
+                     const uint64_t end, std::vector<T> &scratch) {
+    scratch.clear();
+    if (middle - begin <= end - middle) {
+      std::move(buffer.begin() + begin, buffer.begin() + middle,
+                std::back_inserter(scratch));
+      uint64_t out = begin;
+      uint64_t i = 0;
+      uint64_t j = middle;
+      while (i < scratch.size() && j < end) {
+        buffer[out++] =
+            buffer[j] < scratch[i] ? std::move(buffer[j++])
+                                   : std::move(scratch[i++]);
+      }
+      std::move(scratch.begin() + i, scratch.end(), buffer.begin() + out);
+    } else {
+      std::move(buffer.begin() + middle, buffer.begin() + end,
+                std::back_inserter(scratch));
+      uint64_t out = end;
+      uint64_t i = middle;
+      uint64_t j = scratch.size();
+      while (i > begin && j > 0) {
+        buffer[--out] = scratch[j - 1] < buffer[i - 1]
+                            ? std::move(buffer[--i])
+                            : std::move(scratch[--j]);
+      }
+      std::move_backward(scratch.begin(), scratch.begin() + j,
+                         buffer.begin() + out);
+    }
+  }
 
-      // Resize the vector down so that we don't have extra memory growth.
-      // Post "compaction" we should have max_buffer_size/2 elements in the
-      // buffer and it should start growing again.
-      buffer.shrink_to_fit();
-      assert(buffer.size() == target_capacity);
-      assert(buffer.capacity() == target_capacity);
+  // Adds the heap bytes of the items from buffer[first] on.
+  void AddPayload(const uint64_t first) {
+    if constexpr (HeapBytes<T>::kAllocates) {
+      for (uint64_t j = first; j < buffer.size(); ++j) {
+        payload_bytes += HeapBytes<T>::Of(buffer[j]);
+      }
+    }
+  }
 
-      // Update the compactor schedule so we can "randomly" choose new
-      // sections next time.
-      ++C;
+  [[nodiscard]] LevelMemoryUsage MemoryUsage() const {
+    LevelMemoryUsage usage;
+    usage.buffer_bytes = buffer.capacity() * sizeof(T) +
+                         run_ends.capacity() * sizeof(uint64_t);
+    usage.payload_bytes = payload_bytes;
+    usage.packed_bytes = packed.PackedBytes();
+    return usage;
+  }
+
+  // Number of items held, packed or not.
+  [[nodiscard]] uint64_t Size() const {
+    return is_packed ? packed.size() : buffer.size();
+  }
+
+  // Returns the items, decoding them into scratch if the level is packed.
+  const std::vector<T> &Items(std::vector<T> &scratch) const {
+    if (!is_packed) {
+      return buffer;
     }
+    packed.Unpack(scratch);
+    return scratch;
+  }
 
-    // Now that we're done compaction (if necessary) we can add the element to
-    // the buffer.
-    buffer.push_back(element);
-    return output;
-  };
+  // Sorts the buffer and moves it into packed storage, releasing the
+  // buffer's memory. Integral T only. Worth it for levels that are rarely
+  // written, i.e. upper levels between compactions of the level below.
+  void Pack() {
+    if (is_packed) {
+      return;
+    }
+    if (sorted_runs) {
+      MergeRuns();
+    } else {
+      std::sort(buffer.begin(), buffer.end());
+    }
+    packed = PackedSortedLevel<T>(buffer);
+    std::vector<T>().swap(buffer);
+    run_ends.clear();
+    is_packed = true;
+  }
+
+  // Leaves the buffer as one sorted run, merging its runs if it has them.
+  // Packed levels are sorted already. An empty buffer has no runs.
+  void Sort() {
+    if (is_packed) {
+      return;
+    }
+    if (sorted_runs) {
+      MergeRuns();
+    } else {
+      std::sort(buffer.begin(), buffer.end());
+    }
+    sorted_runs = true;
+    run_ends.clear();
+    if (!buffer.empty()) {
+      run_ends.push_back(buffer.size());
+    }
+  }
+
+  // Number of items less than value. Requires a sorted level (see Sort()).
+  [[nodiscard]] uint64_t LowerBound(const T &value) const {
+    if (is_packed) {
+      return packed.LowerBound(value);
+    }
+    assert(sorted_runs && run_ends.size() <= 1);
+    return BranchlessLowerBound(buffer.data(), buffer.size(), value);
+  }
+
+  // Restores the buffer from packed storage as a single sorted run, or no
+  // run at all if the level was empty.
+  void Unpack() {
+    if (!is_packed) {
+      return;
+    }
+    packed.Unpack(buffer);
+    packed = PackedSortedLevel<T>();
+    sorted_runs = true;
+    run_ends.clear();
+    if (!buffer.empty()) {
+      run_ends.push_back(buffer.size());
+    }
+    is_packed = false;
+  }
 
   void Print() const {
-    fmt::print("{}: Compactor n {} k {} max_buffer_size {} C {}\n", h, n, k,
-               max_buffer_size, C);
-    fmt::print("  Buffer:\n");
-    std::for_each(buffer.begin(), buffer.end(),
+    fmt::print("{}: Compactor n {} k {} m {} max_buffer_size {} C {}\n", h, n,
+               k, m, max_buffer_size, C);
+    fmt::print("  Buffer{}:\n", is_packed ? " (packed)" : "");
+    std::vector<T> scratch;
+    const std::vector<T> &items = Items(scratch);
+    std::for_each(items.begin(), items.end(),
                   [](const T &item) -> void { fmt::print("    {}\n", item); });
   }
 };
@@ -42,3 +42,56 @@ TEST(CompactorTest, CompactionInitialState) {
   ASSERT_EQ(compactor.buffer.size(), 0);
   ASSERT_EQ(compactor.C, 0);
 }
+
+TEST(CompactorTest, BufferSizeShortStream) {
+  // A stream no longer than k still gets one section to compact.
+  Compactor<int> compactor(16, 16, 0);
+  ASSERT_EQ(compactor.m, 1);
+  ASSERT_EQ(compactor.max_buffer_size, 32);
+}
+
+TEST(CompactorTest, InsertRunMergesRuns) {
+  Compactor<int> compactor(2, 8, 0);
+  std::vector<int> output;
+  const std::vector<int> high = {5, 6, 7, 8};
+  const std::vector<int> low = {1, 2, 3, 4};
+  compactor.InsertRun(high.data(), high.data() + high.size(), output);
+  compactor.InsertRun(low.data(), low.data() + low.size(), output);
+  ASSERT_TRUE(compactor.sorted_runs);
+  ASSERT_EQ(compactor.run_ends, (std::vector<uint64_t>{4, 8}));
+  ASSERT_TRUE(output.empty());
+
+  // The buffer is full, so the next run compacts one section (2 items) after
+  // merging the runs, leaving the six smallest items sorted in front.
+  const int next = 9;
+  compactor.InsertRun(&next, &next + 1, output);
+  ASSERT_EQ(output.size(), 1);
+  ASSERT_TRUE(output[0] == 7 || output[0] == 8);
+  ASSERT_EQ(compactor.buffer, (std::vector<int>{1, 2, 3, 4, 5, 6, 9}));
+  ASSERT_EQ(compactor.run_ends, (std::vector<uint64_t>{7}));
+}
+
+TEST(CompactorTest, InsertBreaksRuns) {
+  Compactor<int> compactor(2, 8, 0);
+  std::vector<int> output;
+  const std::vector<int> run = {1, 2, 3};
+  compactor.InsertRun(run.data(), run.data() + run.size(), output);
+  compactor.Insert(0);
+  ASSERT_FALSE(compactor.sorted_runs);
+  ASSERT_TRUE(compactor.run_ends.empty());
+}
+
+TEST(CompactorTest, SeededCompactionsRepeat) {
+  // The same seed picks the same even/odd halves, compaction after
+  // compaction.
+  std::vector<int> outputs[2];
+  for (auto &output : outputs) {
+    SeedRandomBoolean(29);
+    Compactor<int> compactor(2, 8, 0);
+    for (int i = 0; i < 1000; ++i) {
+      compactor.InsertRun(&i, &i + 1, output);
+    }
+  }
+  ASSERT_EQ(outputs[0], outputs[1]);
+  ASSERT_GT(outputs[0].size(), 100);
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "relative_error_quantiles_sketch.h"
+
+struct ConcurrentSketchOptions {
+  // Items per shared level-0 buffer.
+  uint64_t buffer_size = 4096;
+  // Number of buffers writers rotate through. While a full buffer is being
+  // drained into the sketch, writers fill the next ones; with ring_size
+  // buffers, ring_size - 1 drains can be in flight before writers wait.
+  // Must be a power of two.
+  uint64_t ring_size = 4;
+};
+
+// One sketch shared by many writer threads, so memory stays near that of a
+// single sketch (plus ring_size * buffer_size staged items) however many
+// threads insert. Per-thread sketches would multiply it by the thread count.
+//
+// Writers reserve a slot in the current level-0 buffer with one fetch_add
+// on a word holding (generation << 32) | slot, write their item and count
+// it as committed. The writer whose commit completes the buffer drains it
+// into the sketch under a mutex, which is where all compaction happens;
+// meanwhile the writer that drew slot == buffer_size has moved everyone on
+// to the next buffer of the ring. Writers only wait when every buffer of the
+// ring is full or draining.
+//
+// Flush(), Close() and Sketch() need quiescence: no Insert() may be running.
+template <typename T> class ConcurrentSketch {
+public:
+  explicit ConcurrentSketch(const RelativeErrorQuantilesSketchOptions &options,
+                            const ConcurrentSketchOptions &concurrency = {})
+      : sketch_(options), buffer_size_(concurrency.buffer_size),
+        ring_(concurrency.ring_size) {
+    assert(buffer_size_ > 0 && buffer_size_ < kSlotMask);
+    assert(ring_.size() > 0 && (ring_.size() & (ring_.size() - 1)) == 0);
+    for (auto &buffer : ring_) {
+      buffer.items.resize(buffer_size_);
+    }
+    ring_[0].free.store(false, std::memory_order_relaxed);
+  }
+
+  // Safe to call from any number of threads at once.
+  void Insert(const T &item) {
+    while (true) {
+      const uint64_t state = state_.fetch_add(1, std::memory_order_acq_rel);
+      const uint32_t generation = static_cast<uint32_t>(state >> 32);
+      const uint64_t slot = state & kSlotMask;
+      if (slot < buffer_size_) {
+        Buffer &buffer = ring_[generation & (ring_.size() - 1)];
+        buffer.items[slot] = item;
+        if (buffer.committed.fetch_add(1, std::memory_order_acq_rel) + 1 ==
+            buffer_size_) {
+          Drain(buffer, buffer_size_);
+        }
+        return;
+      }
+      if (slot == buffer_size_) {
+        Advance(generation);
+      } else {
+        // Another writer is advancing; our increment is discarded with the
+        // old generation.
+        while (static_cast<uint32_t>(
+                   state_.load(std::memory_order_acquire) >> 32) ==
+               generation) {
+          std::this_thread::yield();
+        }
+      }
+    }
+  }
+
+  // Moves the items of the partly filled current buffer into the sketch.
+  void Flush() {
+    const uint64_t state = state_.load(std::memory_order_acquire);
+    const uint32_t generation = static_cast<uint32_t>(state >> 32);
+    const uint64_t slot = std::min(state & kSlotMask, buffer_size_);
+    Buffer &buffer = ring_[generation & (ring_.size() - 1)];
+    if (slot < buffer_size_) {
+      assert(buffer.committed.load() == slot);
+      std::lock_guard<std::mutex> lock(mutex_);
+      sketch_.InsertBatch(std::make_move_iterator(buffer.items.begin()),
+                          std::make_move_iterator(buffer.items.begin() + slot));
+      buffer.committed.store(0, std::memory_order_relaxed);
+    } else {
+      // A full buffer was drained by the writer that completed it.
+      buffer.free.store(false, std::memory_order_relaxed);
+    }
+    // Keep filling the same buffer from its start.
+    state_.store(static_cast<uint64_t>(generation) << 32,
+                 std::memory_order_release);
+  }
+
+  void Close() {
+    Flush();
+    sketch_.Close();
+  }
+
+  // The shared sketch. Call Flush() first to include staged items.
+  [[nodiscard]] RelativeErrorQuantilesSketch<T> &Sketch() { return sketch_; }
+  [[nodiscard]] const RelativeErrorQuantilesSketch<T> &Sketch() const {
+    return sketch_;
+  }
+
+  // Bytes held by the ring buffers, on top of Sketch().MemoryUsage().
+  [[nodiscard]] uint64_t RingBytes() const {
+    uint64_t bytes = ring_.capacity() * sizeof(Buffer);
+    for (const auto &buffer : ring_) {
+      bytes += buffer.items.capacity() * sizeof(T);
+    }
+    return bytes;
+  }
+
+private:
+  static constexpr uint64_t kSlotMask = 0xffffffff;
+
+  struct alignas(64) Buffer {
+    std::vector<T> items;
+    std::atomic<uint64_t> committed{0};
+    // Drained and ready to be handed out again.
+    std::atomic<bool> free{true};
+  };
+
+  void Drain(Buffer &buffer, const uint64_t count) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      sketch_.InsertBatch(
+          std::make_move_iterator(buffer.items.begin()),
+          std::make_move_iterator(buffer.items.begin() + count));
+    }
+    buffer.committed.store(0, std::memory_order_relaxed);
+    buffer.free.store(true, std::memory_order_release);
+  }
+
+  // Publishes generation + 1 once its buffer has been drained.
+  void Advance(const uint32_t generation) {
+    const uint32_t next = generation + 1;
+    Buffer &buffer = ring_[next & (ring_.size() - 1)];
+    while (!buffer.free.load(std::memory_order_acquire)) {
+      std::this_thread::yield();
+    }
+    buffer.free.store(false, std::memory_order_relaxed);
+    state_.store(static_cast<uint64_t>(next) << 32, std::memory_order_release);
+  }
+
+  RelativeErrorQuantilesSketch<T> sketch_;
+  const uint64_t buffer_size_;
+  std::vector<Buffer> ring_;
+  std::mutex mutex_;
+  alignas(64) std::atomic<uint64_t> state_{0};
+};
@@ -0,0 +1,57 @@
+#include "concurrent_sketch.h"
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(ConcurrentSketchTest, ManyWriters) {
+  RelativeErrorQuantilesSketchOptions options = {
+      .n = 1 << 20, .k = 64, .staging_size = 64};
+  // Small buffers and a short ring so writers wrap around it many times.
+  ConcurrentSketch<uint64_t> sketch(options,
+                                    {.buffer_size = 256, .ring_size = 2});
+  const uint64_t threads = 8;
+  const uint64_t per_thread = 100'001;
+  std::vector<std::thread> writers;
+  for (uint64_t t = 0; t < threads; ++t) {
+    writers.emplace_back([&, t] {
+      for (uint64_t i = 0; i < per_thread; ++i) {
+        sketch.Insert(i * threads + t);
+      }
+    });
+  }
+  for (auto &writer : writers) {
+    writer.join();
+  }
+  sketch.Close();
+  const auto &closed = sketch.Sketch();
+  ASSERT_EQ(closed.TotalWeight(), threads * per_thread);
+  ASSERT_EQ(closed.GetQuantile(0.0), 0);
+  const double median = closed.GetQuantile(0.5);
+  ASSERT_NEAR(median / (threads * per_thread), 0.5, 0.05);
+}
+
+TEST(ConcurrentSketchTest, FlushPartialAndFullBuffers) {
+  RelativeErrorQuantilesSketchOptions options = {.n = 1 << 16, .k = 16};
+  ConcurrentSketch<std::string> sketch(options,
+                                       {.buffer_size = 10, .ring_size = 1});
+  // Exactly one full buffer: drained by its last writer, nothing to flush.
+  for (int i = 0; i < 10; ++i) {
+    sketch.Insert(fmt::format("key-{:02}", i));
+  }
+  sketch.Flush();
+  ASSERT_EQ(sketch.Sketch().RetainedItems(), 10);
+  // Then a partial one.
+  for (int i = 10; i < 13; ++i) {
+    sketch.Insert(fmt::format("key-{:02}", i));
+  }
+  sketch.Flush();
+  ASSERT_EQ(sketch.Sketch().RetainedItems(), 13);
+  for (int i = 13; i < 30; ++i) {
+    sketch.Insert(fmt::format("key-{:02}", i));
+  }
+  sketch.Close();
+  ASSERT_EQ(sketch.Sketch().TotalWeight(), 30);
+  ASSERT_EQ(sketch.Sketch().GetQuantile(1.0), "key-29");
+}
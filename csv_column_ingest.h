@@ -0,0 +1,297 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <sys/mman.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "mapped_file.h"
+#include "relative_error_quantiles_sketch.h"
+
+// Returns a bitmask with bit i set when data[i] is delimiter or a newline,
+// for the 64 bytes starting at data.
+inline uint64_t FieldBoundaryMask(const char *data, const char delimiter) {
+#if defined(__AVX2__)
+  const __m256i delimiters = _mm256_set1_epi8(delimiter);
+  const __m256i newlines = _mm256_set1_epi8('\n');
+  const __m256i lo =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+  const __m256i hi =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + 32));
+  const uint32_t lo_mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+      _mm256_or_si256(_mm256_cmpeq_epi8(lo, delimiters),
+                      _mm256_cmpeq_epi8(lo, newlines))));
+  const uint32_t hi_mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+      _mm256_or_si256(_mm256_cmpeq_epi8(hi, delimiters),
+                      _mm256_cmpeq_epi8(hi, newlines))));
+  return (static_cast<uint64_t>(hi_mask) << 32) | lo_mask;
+#elif defined(__SSE2__)
+  const __m128i delimiters = _mm_set1_epi8(delimiter);
+  const __m128i newlines = _mm_set1_epi8('\n');
+  uint64_t mask = 0;
+  for (int i = 0; i < 64; i += 16) {
+    const __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    const uint32_t bits = static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(bytes, delimiters),
+                                       _mm_cmpeq_epi8(bytes, newlines))));
+    mask |= static_cast<uint64_t>(bits) << i;
+  }
+  return mask;
+#else
+  uint64_t mask = 0;
+  for (int i = 0; i < 64; ++i) {
+    mask |= static_cast<uint64_t>(data[i] == delimiter || data[i] == '\n')
+            << i;
+  }
+  return mask;
+#endif
+}
+
+// Calls function(field) with the given zero-based column of every line in
+// [begin, end), which must start at the beginning of a line. Lines with too
+// few fields are skipped. A trailing '\r' is stripped from the last field of
+// a line. Fields are split on every delimiter; quoting is not supported.
+template <typename Function>
+void ForEachCsvField(const char *begin, const char *end, const char delimiter,
+                     const uint64_t column, Function &&function) {
+  uint64_t field = 0;
+  const char *field_begin = begin;
+  auto boundary = [&](const char *position) {
+    if (field == column) {
+      const char *field_end = position;
+      if (*position == '\n' && field_end > field_begin &&
+          field_end[-1] == '\r') {
+        --field_end;
+      }
+      function(std::string_view(field_begin, field_end - field_begin));
+    }
+    field = *position == '\n' ? 0 : field + 1;
+    field_begin = position + 1;
+  };
+
+  const char *position = begin;
+  for (; position + 64 <= end; position += 64) {
+    for (uint64_t mask = FieldBoundaryMask(position, delimiter); mask != 0;
+         mask &= mask - 1) {
+      boundary(position + __builtin_ctzll(mask));
+    }
+  }
+  for (; position < end; ++position) {
+    if (*position == delimiter || *position == '\n') {
+      boundary(position);
+    }
+  }
+  // Last line without a trailing newline.
+  if (field == column && field_begin < end) {
+    const char *field_end = end;
+    if (field_end[-1] == '\r') {
+      --field_end;
+    }
+    function(std::string_view(field_begin, field_end - field_begin));
+  }
+}
+
+// Parses a field into T. Numbers go through std::from_chars, which rejects
+// surrounding whitespace and trailing garbage. Returns false if the field
+// does not parse.
+template <typename T>
+bool ParseCsvField(const std::string_view field, T &value) {
+  if constexpr (std::is_arithmetic_v<T>) {
+    const char *first = field.data();
+    const char *last = field.data() + field.size();
+    if (first != last && *first == '+') {
+      ++first;
+    }
+    const auto result = std::from_chars(first, last, value);
+    return result.ec == std::errc() && result.ptr == last;
+  } else {
+    value = T(field);
+    return true;
+  }
+}
+
+struct CsvIngestOptions {
+  // Zero-based index of the column to sketch.
+  uint64_t column = 0;
+  char delimiter = ',';
+  // Skip the first line of the file.
+  bool header = false;
+  // Number of ingest threads, each sketching its own chunks. 0 means one per
+  // hardware thread.
+  unsigned threads = 0;
+  // Threads claim the file in chunks of roughly this many bytes, extended to
+  // the next newline.
+  uint64_t chunk_bytes = 16 << 20;
+  // Parsed values are inserted in batches of this size.
+  uint64_t batch_size = 4096;
+};
+
+struct CsvIngestResult {
+  uint64_t lines_inserted = 0;
+  // Lines whose field did not parse as T.
+  uint64_t parse_errors = 0;
+  // Lines whose field was empty (e.g. "a,,c" for column 1). These are
+  // skipped, as the sketch has no value to give a missing field.
+  uint64_t empty_fields = 0;
+};
+
+// Sketches one column of a delimited text file. The file is mapped and split
+// into newline aligned chunks that threads claim from a shared counter.
+// Field boundaries are located 64 bytes at a time with AVX2 (SSE2 or a
+// scalar loop otherwise), the column is parsed into T (from_chars for
+// numbers, constructed from string_view otherwise) and inserted in batches
+// into a per-thread sketch. The per-thread sketches are merged into sketch.
+// Throws std::system_error if the file cannot be mapped. An exception on any
+// thread (e.g. std::length_error for a field too long for an InlineString
+// key) stops the others and is rethrown once all have finished; sketch
+// then holds whatever the calling thread inserted before that.
+template <typename T>
+CsvIngestResult IngestCsvColumn(const std::string &path,
+                                RelativeErrorQuantilesSketch<T> &sketch,
+                                const CsvIngestOptions &ingest) {
+  const MappedFile file(path);
+  file.Advise(0, file.size(), MADV_SEQUENTIAL);
+  const char *data = file.data();
+  const char *data_end = data + file.size();
+
+  const char *start = data;
+  if (ingest.header && start != data_end) {
+    const void *newline = std::memchr(start, '\n', data_end - start);
+    start = newline == nullptr ? data_end
+                               : static_cast<const char *>(newline) + 1;
+  }
+
+  // Chunk boundaries, each just past a newline (or the end of the file).
+  std::vector<const char *> boundaries = {start};
+  while (boundaries.back() != data_end) {
+    const char *next =
+        boundaries.back() +
+        std::min<uint64_t>(ingest.chunk_bytes, data_end - boundaries.back());
+    if (next != data_end) {
+      const void *newline = std::memchr(next, '\n', data_end - next);
+      next = newline == nullptr ? data_end
+                                : static_cast<const char *>(newline) + 1;
+    }
+    boundaries.push_back(next);
+  }
+  const uint64_t chunks = boundaries.size() - 1;
+  if (chunks == 0) {
+    return CsvIngestResult();
+  }
+
+  const unsigned threads = static_cast<unsigned>(std::min<uint64_t>(
+      chunks,
+      ingest.threads > 0 ? ingest.threads
+                         : std::max(1u, std::thread::hardware_concurrency())));
+  std::vector<RelativeErrorQuantilesSketch<T>> sketches(
+      threads - 1, RelativeErrorQuantilesSketch<T>(sketch.Options()));
+  std::vector<CsvIngestResult> results(threads);
+  std::atomic<uint64_t> next_chunk{0};
+
+  auto ingest_chunks = [&](RelativeErrorQuantilesSketch<T> &target,
+                           CsvIngestResult &result) {
+    // Numbers are parsed into a reusable batch; strings are inserted
+    // straight from views into the mapping.
+    using Batched =
+        std::conditional_t<std::is_arithmetic_v<T>, T, std::string_view>;
+    std::vector<Batched> batch;
+    batch.reserve(ingest.batch_size);
+    auto flush = [&] {
+      target.InsertBatch(batch.begin(), batch.end());
+      result.lines_inserted += batch.size();
+      batch.clear();
+    };
+    for (uint64_t chunk = next_chunk.fetch_add(1); chunk < chunks;
+         chunk = next_chunk.fetch_add(1)) {
+      ForEachCsvField(boundaries[chunk], boundaries[chunk + 1],
+                      ingest.delimiter, ingest.column,
+                      [&](const std::string_view field) {
+                        if (field.empty()) {
+                          ++result.empty_fields;
+                          return;
+                        }
+                        if constexpr (std::is_arithmetic_v<T>) {
+                          T value;
+                          if (!ParseCsvField(field, value)) {
+                            ++result.parse_errors;
+                            return;
+                          }
+                          batch.push_back(value);
+                        } else {
+                          batch.push_back(field);
+                        }
+                        if (batch.size() == ingest.batch_size) {
+                          flush();
+                        }
+                      });
+    }
+    flush();
+  };
+
+  // The first exception any thread hits is kept; claiming every remaining
+  // chunk stops the other threads after the chunk they are on.
+  std::mutex error_mutex;
+  std::exception_ptr error;
+  auto fail = [&](std::exception_ptr e) {
+    next_chunk = chunks;
+    std::lock_guard<std::mutex> lock(error_mutex);
+    if (!error) {
+      error = e;
+    }
+  };
+  auto guarded_ingest_chunks = [&](RelativeErrorQuantilesSketch<T> &target,
+                                   CsvIngestResult &result) {
+    try {
+      ingest_chunks(target, result);
+    } catch (...) {
+      fail(std::current_exception());
+    }
+  };
+
+  std::vector<std::thread> workers;
+  try {
+    for (unsigned t = 1; t < threads; ++t) {
+      workers.emplace_back(guarded_ingest_chunks, std::ref(sketches[t - 1]),
+                           std::ref(results[t]));
+    }
+  } catch (...) {
+    fail(std::current_exception());
+  }
+  guarded_ingest_chunks(sketch, results[0]);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+
+  CsvIngestResult total;
+  for (unsigned t = 0; t < threads; ++t) {
+    if (t > 0) {
+      sketch.Merge(sketches[t - 1]);
+    }
+    total.lines_inserted += results[t].lines_inserted;
+    total.parse_errors += results[t].parse_errors;
+    total.empty_fields += results[t].empty_fields;
+  }
+  return total;
+}
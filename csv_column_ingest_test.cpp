@@ -0,0 +1,102 @@
+#include "csv_column_ingest.h"
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "inline_string.h"
+
+std::string WriteCsvFile(const std::string &name, const std::string &text) {
+  const std::string path = ::testing::TempDir() + name;
+  std::ofstream(path, std::ios::binary | std::ios::trunc) << text;
+  return path;
+}
+
+RelativeErrorQuantilesSketchOptions Options() {
+  return RelativeErrorQuantilesSketchOptions{.n = 1 << 20, .k = 64};
+}
+
+TEST(CsvColumnIngestTest, ForEachCsvField) {
+  // Long enough to cross a 64 byte block boundary.
+  const std::string text =
+      "a,b,c\n"
+      "first-row-with-a-long-field-to-push-past-one-block,2,x\r\n"
+      "short\n"
+      "1,2,3,4\n"
+      "7,8,last";
+  std::vector<std::string> fields;
+  ForEachCsvField(text.data(), text.data() + text.size(), ',', 2,
+                  [&](std::string_view field) { fields.emplace_back(field); });
+  ASSERT_EQ(fields, (std::vector<std::string>{"c", "x", "3", "last"}));
+}
+
+TEST(CsvColumnIngestTest, NumericColumnAcrossChunks) {
+  std::string text = "id,latency_ms,host\n";
+  for (int i = 0; i < 20000; ++i) {
+    text += std::to_string(i) + "," + std::to_string(i % 1000) + ".5,h" +
+            std::to_string(i % 7) + "\n";
+  }
+  text += "20000,not-a-number,h0\n";
+  const std::string path = WriteCsvFile("csv_numeric.csv", text);
+
+  RelativeErrorQuantilesSketch<double> sketch(Options());
+  CsvIngestOptions ingest = {
+      .column = 1, .header = true, .threads = 3, .chunk_bytes = 4096};
+  const CsvIngestResult result = IngestCsvColumn(path, sketch, ingest);
+  ASSERT_EQ(result.lines_inserted, 20000);
+  ASSERT_EQ(result.parse_errors, 1);
+  sketch.Close();
+  ASSERT_EQ(sketch.TotalWeight(), 20000);
+  ASSERT_EQ(sketch.GetQuantile(0.0), 0.5);
+  std::remove(path.c_str());
+}
+
+TEST(CsvColumnIngestTest, StringColumn) {
+  const std::string path = WriteCsvFile(
+      "csv_strings.csv", "GET\t/b\t200\nGET\t/a\t404\nPUT\t/c\t200\n");
+  RelativeErrorQuantilesSketch<std::string> sketch(Options());
+  CsvIngestOptions ingest = {.column = 1, .delimiter = '\t'};
+  IngestCsvColumn(path, sketch, ingest);
+  sketch.Close();
+  ASSERT_EQ(sketch.Items(), (std::vector<std::string>{"/a", "/b", "/c"}));
+  std::remove(path.c_str());
+}
+
+TEST(CsvColumnIngestTest, EmptyFieldsSkipped) {
+  const std::string path =
+      WriteCsvFile("csv_empty.csv", "a,,c\nb,y,d\ne,x,f\ng,\nh,,i\r\n");
+  RelativeErrorQuantilesSketch<std::string> strings(Options());
+  const CsvIngestResult result = IngestCsvColumn(path, strings, {.column = 1});
+  ASSERT_EQ(result.lines_inserted, 2);
+  ASSERT_EQ(result.empty_fields, 3);
+  strings.Close();
+  ASSERT_EQ(strings.Items(), (std::vector<std::string>{"x", "y"}));
+
+  // Numeric columns skip them too rather than count a parse error.
+  const std::string numbers =
+      WriteCsvFile("csv_empty_numbers.csv", "1,,3\n4,5,6\n");
+  RelativeErrorQuantilesSketch<int> ints(Options());
+  const CsvIngestResult numeric = IngestCsvColumn(numbers, ints, {.column = 1});
+  ASSERT_EQ(numeric.lines_inserted, 1);
+  ASSERT_EQ(numeric.empty_fields, 1);
+  ASSERT_EQ(numeric.parse_errors, 0);
+  std::remove(path.c_str());
+  std::remove(numbers.c_str());
+}
+
+TEST(CsvColumnIngestTest, WorkerExceptionRethrown) {
+  // Every chunk holds a field too long for InlineString<8>, so whichever
+  // thread reaches one throws std::length_error.
+  std::string text;
+  for (int i = 0; i < 2000; ++i) {
+    text += "id," + std::to_string(i) + "-a-field-longer-than-eight-bytes\n";
+  }
+  const std::string path = WriteCsvFile("csv_long_fields.csv", text);
+  RelativeErrorQuantilesSketch<InlineString<8>> sketch(Options());
+  CsvIngestOptions ingest = {.column = 1, .threads = 4, .chunk_bytes = 1024};
+  ASSERT_THROW(IngestCsvColumn(path, sketch, ingest), std::length_error);
+  std::remove(path.c_str());
+}
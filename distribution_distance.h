@@ -0,0 +1,66 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "relative_error_quantiles_sketch.h"
+
+struct DistributionDistance {
+  // Largest absolute difference between the two normalized CDFs.
+  double kolmogorov_smirnov = 0.0;
+  // Largest |F(x) - G(x)| / G(x), where G is the baseline CDF, over the
+  // points where G(x) > 0. This is the quantity the relative error guarantee
+  // bounds, so it highlights drift in the low tail that the KS distance
+  // hides.
+  double max_relative_rank_difference = 0.0;
+};
+
+// Compares two closed sketches by walking their sorted views together once,
+// evaluating both CDFs right after every distinct item. O(n + m) with no
+// allocation, where n and m are the view sizes.
+template <typename T>
+DistributionDistance
+ComputeDistributionDistance(const RelativeErrorQuantilesSketch<T> &sketch,
+                            const RelativeErrorQuantilesSketch<T> &baseline) {
+  DistributionDistance distance;
+  const std::vector<T> &items = sketch.Items();
+  const std::vector<double> &weights = sketch.CumulativeWeights();
+  const std::vector<T> &baseline_items = baseline.Items();
+  const std::vector<double> &baseline_weights = baseline.CumulativeWeights();
+  if (items.empty() || baseline_items.empty()) {
+    return distance;
+  }
+
+  const double scale = 1.0 / weights.back();
+  const double baseline_scale = 1.0 / baseline_weights.back();
+  uint64_t i = 0;
+  uint64_t j = 0;
+  while (i < items.size() || j < baseline_items.size()) {
+    // Next distinct item in either view; equal items advance both sides so
+    // the CDFs are compared after all copies of the item.
+    const T &next = j == baseline_items.size() ||
+                            (i < items.size() && items[i] < baseline_items[j])
+                        ? items[i]
+                        : baseline_items[j];
+    while (i < items.size() && !(next < items[i])) {
+      ++i;
+    }
+    while (j < baseline_items.size() && !(next < baseline_items[j])) {
+      ++j;
+    }
+
+    const double cdf = i == 0 ? 0.0 : weights[i - 1] * scale;
+    const double baseline_cdf =
+        j == 0 ? 0.0 : baseline_weights[j - 1] * baseline_scale;
+    const double difference = std::abs(cdf - baseline_cdf);
+    distance.kolmogorov_smirnov =
+        std::max(distance.kolmogorov_smirnov, difference);
+    if (baseline_cdf > 0.0) {
+      distance.max_relative_rank_difference = std::max(
+          distance.max_relative_rank_difference, difference / baseline_cdf);
+    }
+  }
+  return distance;
+}
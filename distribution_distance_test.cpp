@@ -0,0 +1,36 @@
+#include "distribution_distance.h"
+#include <gtest/gtest.h>
+
+RelativeErrorQuantilesSketch<int> ExactSketch(int first, int last) {
+  RelativeErrorQuantilesSketchOptions options = {.n = 1 << 16, .k = 64};
+  RelativeErrorQuantilesSketch<int> sketch(options);
+  for (int i = first; i < last; ++i) {
+    sketch.Insert(i, 0);
+  }
+  sketch.Close();
+  return sketch;
+}
+
+TEST(DistributionDistanceTest, IdenticalSketches) {
+  const auto sketch = ExactSketch(0, 1000);
+  const auto distance = ComputeDistributionDistance(sketch, sketch);
+  ASSERT_EQ(distance.kolmogorov_smirnov, 0.0);
+  ASSERT_EQ(distance.max_relative_rank_difference, 0.0);
+}
+
+TEST(DistributionDistanceTest, DisjointSketches) {
+  const auto low = ExactSketch(0, 1000);
+  const auto high = ExactSketch(1000, 2000);
+  ASSERT_EQ(ComputeDistributionDistance(low, high).kolmogorov_smirnov, 1.0);
+  ASSERT_EQ(ComputeDistributionDistance(high, low).kolmogorov_smirnov, 1.0);
+}
+
+TEST(DistributionDistanceTest, ShiftedSketches) {
+  // [0, 1000) against [100, 1100): the CDFs differ by 0.1 over the overlap.
+  const auto sketch = ExactSketch(0, 1000);
+  const auto baseline = ExactSketch(100, 1100);
+  const auto distance = ComputeDistributionDistance(sketch, baseline);
+  ASSERT_NEAR(distance.kolmogorov_smirnov, 0.1, 1e-12);
+  // At x = 100 the baseline has rank 1/1000 and the sketch 101/1000.
+  ASSERT_NEAR(distance.max_relative_rank_difference, 100.0, 1e-9);
+}
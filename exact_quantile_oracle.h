@@ -0,0 +1,436 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <fmt/format.h>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <queue>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "memory_usage.h"
+#include "thread_pool.h"
+
+// Reads size bytes of a run file into data. Returns false if the file ends
+// before the first byte and at_item_start is set, i.e. at a clean end of
+// the run. Throws std::system_error on a read error or if the file ends
+// part way through an item.
+inline bool ReadRunBytes(std::FILE *file, void *data, const size_t size,
+                         const bool at_item_start) {
+  const size_t read = std::fread(data, 1, size, file);
+  if (read == size) {
+    return true;
+  }
+  if (std::ferror(file)) {
+    throw std::system_error(errno != 0 ? errno : EIO, std::generic_category(),
+                            "read run file");
+  }
+  if (read > 0 || !at_item_start) {
+    throw std::system_error(EIO, std::generic_category(),
+                            "truncated run file");
+  }
+  return false;
+}
+
+// How items are stored in run files: trivially copyable types as their raw
+// bytes, std::string as a uint32 length followed by the bytes. Specialize
+// for other key types. Read returns false at the end of the file and throws
+// std::system_error if the file cannot be read or ends inside an item.
+template <typename T> struct RunCodec {
+  static_assert(std::is_trivially_copyable_v<T>,
+                "specialize RunCodec for this key type");
+  static bool Write(std::FILE *file, const T &item) {
+    return std::fwrite(&item, sizeof(T), 1, file) == 1;
+  }
+  static bool Read(std::FILE *file, T &item) {
+    return ReadRunBytes(file, &item, sizeof(T), true);
+  }
+};
+
+template <> struct RunCodec<std::string> {
+  static bool Write(std::FILE *file, const std::string &item) {
+    const uint32_t length = static_cast<uint32_t>(item.size());
+    return std::fwrite(&length, sizeof(length), 1, file) == 1 &&
+           std::fwrite(item.data(), 1, item.size(), file) == item.size();
+  }
+  static bool Read(std::FILE *file, std::string &item) {
+    uint32_t length = 0;
+    if (!ReadRunBytes(file, &length, sizeof(length), true)) {
+      return false;
+    }
+    item.resize(length);
+    return ReadRunBytes(file, item.data(), length, false);
+  }
+};
+
+struct ExactQuantileOracleOptions {
+  // Where run files are written. They are deleted with the oracle.
+  std::string directory = "/tmp";
+  // Bytes of items held in memory, counting heap bytes of the items (see
+  // HeapBytes). Split between the buffer being filled and one buffer per
+  // sorting thread while adding, and between the file buffers of the runs
+  // being merged after that.
+  uint64_t memory_bytes = uint64_t{1} << 30;
+  // Threads sorting and writing runs, 0 for one per hardware thread.
+  unsigned threads = 0;
+};
+
+// Exact ranks and quantiles of a stream too large for memory, to measure a
+// sketch's error against. Items are buffered up to a share of the memory
+// budget; each full buffer is sorted and written to a run file on a pool
+// thread while the next one fills. Queries then stream a k-way merge of
+// the runs, so each costs one sequential read of everything added, and a
+// billion 84-byte keys need about 90 GB of disk.
+//
+// A merge reads every run through its own file buffer, so it opens at most
+// kMaxFanIn runs and as many as memory_bytes holds buffers of at least
+// kMinFileBufferBytes. If Finish() is left with more runs than that, it
+// merges them into fewer, longer runs first.
+//
+// Add() items from one thread, then Finish(), then query. Throws
+// std::system_error on I/O errors.
+template <typename T> class ExactQuantileOracle {
+public:
+  explicit ExactQuantileOracle(const ExactQuantileOracleOptions &options = {})
+      : options_(options), pool_(options.threads),
+        buffer_bytes_(options.memory_bytes / (pool_.Size() + 1)),
+        // One file buffer goes to the output of an intermediate merge.
+        fan_in_(std::clamp<uint64_t>(options.memory_bytes / kMinFileBufferBytes,
+                                     3, kMaxFanIn + 1) -
+                1),
+        file_buffer_bytes_(std::clamp<uint64_t>(
+            options.memory_bytes / (fan_in_ + 1), 1, kMaxFileBufferBytes)),
+        id_(next_id_.fetch_add(1)) {}
+
+  ~ExactQuantileOracle() {
+    WaitForRuns(0);
+    for (const auto &path : run_paths_) {
+      std::remove(path.c_str());
+    }
+  }
+
+  ExactQuantileOracle(const ExactQuantileOracle &) = delete;
+  ExactQuantileOracle &operator=(const ExactQuantileOracle &) = delete;
+
+  void Add(const T &item) {
+    assert(!finished_);
+    buffer_.push_back(item);
+    bytes_ += sizeof(T) + HeapBytes<T>::Of(buffer_.back());
+    ++count_;
+    if (bytes_ >= buffer_bytes_) {
+      WriteRun();
+    }
+  }
+
+  template <typename Iterator> void Add(Iterator first, Iterator last) {
+    for (; first != last; ++first) {
+      Add(*first);
+    }
+  }
+
+  // Writes the last run, waits for all of them and merges them down to at
+  // most one merge's fan-in.
+  void Finish() {
+    if (!buffer_.empty()) {
+      WriteRun();
+    }
+    WaitForRuns(0);
+    CheckRuns();
+    MergeRunsToFanIn();
+    finished_ = true;
+  }
+
+  [[nodiscard]] uint64_t Count() const { return count_; }
+  // Sorted runs written while adding.
+  [[nodiscard]] uint64_t Runs() const { return runs_; }
+  // Runs Finish() wrote by merging others, zero unless there were more
+  // runs than one merge can open.
+  [[nodiscard]] uint64_t IntermediateMerges() const {
+    return intermediate_merges_;
+  }
+
+  // Calls visit(item) for every item in ascending order until it returns
+  // false.
+  template <typename Visit> void ForEachSorted(Visit &&visit) const {
+    assert(finished_);
+    Merge(run_paths_.begin(), run_paths_.end(), visit);
+  }
+
+  // Number of items less than each probe, in one merge pass.
+  [[nodiscard]] std::vector<uint64_t>
+  Ranks(const std::vector<T> &probes) const {
+    std::vector<uint64_t> order(probes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](uint64_t a, uint64_t b) {
+      return probes[a] < probes[b];
+    });
+    std::vector<uint64_t> ranks(probes.size(), count_);
+    uint64_t next = 0;
+    uint64_t seen = 0;
+    ForEachSorted([&](const T &item) {
+      while (next < order.size() && !(probes[order[next]] > item)) {
+        ranks[order[next++]] = seen;
+      }
+      ++seen;
+      return next < order.size();
+    });
+    return ranks;
+  }
+
+  // For each rank in [0, 1], the smallest item whose inclusive rank
+  // reaches rank * Count(), as the sketch's GetQuantile() defines it, in
+  // one merge pass.
+  [[nodiscard]] std::vector<T>
+  Quantiles(const std::vector<double> &ranks) const {
+    assert(count_ > 0);
+    std::vector<uint64_t> positions(ranks.size());
+    for (uint64_t i = 0; i < ranks.size(); ++i) {
+      const double target = std::ceil(ranks[i] * count_);
+      positions[i] = std::min<uint64_t>(
+          std::max<double>(target, 1.0) - 1, count_ - 1);
+    }
+    std::vector<uint64_t> order(ranks.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](uint64_t a, uint64_t b) {
+      return positions[a] < positions[b];
+    });
+    std::vector<T> quantiles(ranks.size());
+    uint64_t next = 0;
+    uint64_t position = 0;
+    ForEachSorted([&](const T &item) {
+      while (next < order.size() && positions[order[next]] == position) {
+        quantiles[order[next++]] = item;
+      }
+      ++position;
+      return next < order.size();
+    });
+    return quantiles;
+  }
+
+private:
+  // Buffered sequential reader of one run file.
+  struct Reader {
+    Reader(const std::string &path, const uint64_t buffer_bytes)
+        : path(path), file(std::fopen(path.c_str(), "rb")) {
+      if (file == nullptr) {
+        throw std::system_error(errno, std::generic_category(),
+                                "open " + path);
+      }
+      std::setvbuf(file, nullptr, _IOFBF, buffer_bytes);
+    }
+    ~Reader() {
+      if (file != nullptr) {
+        std::fclose(file);
+      }
+    }
+    Reader(Reader &&other) noexcept
+        : path(std::move(other.path)),
+          file(std::exchange(other.file, nullptr)),
+          item(std::move(other.item)) {}
+    Reader(const Reader &) = delete;
+
+    bool Next() {
+      try {
+        return RunCodec<T>::Read(file, item);
+      } catch (const std::system_error &error) {
+        throw std::system_error(error.code(), "read " + path);
+      }
+    }
+
+    std::string path;
+    std::FILE *file;
+    T item{};
+  };
+
+  // Buffered sequential writer of one run file.
+  struct Writer {
+    Writer(const std::string &path, const uint64_t buffer_bytes)
+        : path(path), file(std::fopen(path.c_str(), "wb")) {
+      if (file == nullptr) {
+        throw std::system_error(errno, std::generic_category(),
+                                "open " + path);
+      }
+      std::setvbuf(file, nullptr, _IOFBF, buffer_bytes);
+    }
+    ~Writer() {
+      if (file != nullptr) {
+        std::fclose(file);
+      }
+    }
+    Writer(const Writer &) = delete;
+
+    void Write(const T &item) {
+      if (!RunCodec<T>::Write(file, item)) {
+        throw std::system_error(errno, std::generic_category(),
+                                "write " + path);
+      }
+    }
+    void Close() {
+      if (std::fclose(std::exchange(file, nullptr)) != 0) {
+        throw std::system_error(errno, std::generic_category(),
+                                "write " + path);
+      }
+    }
+
+    std::string path;
+    std::FILE *file;
+  };
+
+  static constexpr uint64_t kMaxFanIn = 256;
+  static constexpr uint64_t kMinFileBufferBytes = 4 << 10;
+  static constexpr uint64_t kMaxFileBufferBytes = 1 << 20;
+
+  // Calls visit(item) for every item of the runs [first, last) in ascending
+  // order until it returns false.
+  template <typename Iterator, typename Visit>
+  void Merge(Iterator first, Iterator last, Visit &&visit) const {
+    assert(static_cast<uint64_t>(last - first) <= fan_in_);
+    std::vector<Reader> readers;
+    readers.reserve(last - first);
+    for (; first != last; ++first) {
+      readers.emplace_back(*first, file_buffer_bytes_);
+    }
+    const auto greater = [&readers](const uint64_t a, const uint64_t b) {
+      return readers[b].item < readers[a].item;
+    };
+    std::priority_queue<uint64_t, std::vector<uint64_t>, decltype(greater)>
+        heap(greater);
+    for (uint64_t r = 0; r < readers.size(); ++r) {
+      if (readers[r].Next()) {
+        heap.push(r);
+      }
+    }
+    while (!heap.empty()) {
+      const uint64_t r = heap.top();
+      heap.pop();
+      if (!visit(static_cast<const T &>(readers[r].item))) {
+        return;
+      }
+      if (readers[r].Next()) {
+        heap.push(r);
+      }
+    }
+  }
+
+  // Merges runs into longer ones until a single merge can open them all.
+  // The first merge takes just enough runs that every later one takes a
+  // full fan-in, which keeps the number of items rewritten low.
+  void MergeRunsToFanIn() {
+    uint64_t merge_size = run_paths_.size() <= fan_in_
+                              ? 0
+                              : (run_paths_.size() - 2) % (fan_in_ - 1) + 2;
+    while (run_paths_.size() > fan_in_) {
+      const std::string path = RunPath();
+      run_paths_.push_back(path);
+      Writer writer(path, file_buffer_bytes_);
+      Merge(run_paths_.begin(), run_paths_.begin() + merge_size,
+            [&writer](const T &item) {
+              writer.Write(item);
+              return true;
+            });
+      writer.Close();
+      for (uint64_t r = 0; r < merge_size; ++r) {
+        std::remove(run_paths_[r].c_str());
+      }
+      run_paths_.erase(run_paths_.begin(), run_paths_.begin() + merge_size);
+      ++intermediate_merges_;
+      merge_size = fan_in_;
+    }
+  }
+
+  std::string RunPath() {
+    return fmt::format("{}/exact-oracle-{}-{}-{}.run", options_.directory,
+                       ::getpid(), id_, next_run_++);
+  }
+
+  // Hands the buffer to the pool to be sorted and written, once fewer than
+  // one run per thread is in flight.
+  void WriteRun() {
+    WaitForRuns(pool_.Size() - 1);
+    CheckRuns();
+    const std::string path = RunPath();
+    run_paths_.push_back(path);
+    ++runs_;
+    auto items = std::make_shared<std::vector<T>>(std::move(buffer_));
+    buffer_ = std::vector<T>();
+    bytes_ = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++in_flight_;
+    }
+    pool_.Submit([this, items, path]() mutable {
+      std::exception_ptr error;
+      try {
+        std::sort(items->begin(), items->end());
+        WriteFile(path, *items);
+      } catch (...) {
+        error = std::current_exception();
+      }
+      items.reset();
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (error && !error_) {
+        error_ = error;
+      }
+      --in_flight_;
+      run_done_.notify_all();
+    });
+  }
+
+  void WriteFile(const std::string &path, const std::vector<T> &items) const {
+    Writer writer(path, file_buffer_bytes_);
+    for (const T &item : items) {
+      writer.Write(item);
+    }
+    writer.Close();
+  }
+
+  // Waits until at most limit runs are being written.
+  void WaitForRuns(const uint64_t limit) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    run_done_.wait(lock, [&] { return in_flight_ <= limit; });
+  }
+
+  // Rethrows the first error a run hit.
+  void CheckRuns() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (error_) {
+      std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+  }
+
+  inline static std::atomic<uint64_t> next_id_{0};
+
+  const ExactQuantileOracleOptions options_;
+  ThreadPool pool_;
+  const uint64_t buffer_bytes_;
+  // Runs one merge reads at once and the stdio buffer of each run file.
+  const uint64_t fan_in_;
+  const uint64_t file_buffer_bytes_;
+  const uint64_t id_;
+  std::vector<T> buffer_;
+  uint64_t bytes_ = 0;
+  uint64_t count_ = 0;
+  bool finished_ = false;
+  uint64_t runs_ = 0;
+  uint64_t intermediate_merges_ = 0;
+  uint64_t next_run_ = 0;
+  std::vector<std::string> run_paths_;
+  std::mutex mutex_;
+  std::condition_variable run_done_;
+  uint64_t in_flight_ = 0;
+  std::exception_ptr error_;
+};
@@ -0,0 +1,111 @@
+#include "exact_quantile_oracle.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+template <typename T>
+void ExpectExact(ExactQuantileOracle<T> &oracle, std::vector<T> items,
+                 const std::vector<T> &probes) {
+  oracle.Add(items.begin(), items.end());
+  oracle.Finish();
+  ASSERT_EQ(oracle.Count(), items.size());
+  std::sort(items.begin(), items.end());
+
+  std::vector<T> sorted;
+  oracle.ForEachSorted([&](const T &item) {
+    sorted.push_back(item);
+    return true;
+  });
+  ASSERT_EQ(sorted, items);
+
+  const std::vector<uint64_t> ranks = oracle.Ranks(probes);
+  for (size_t i = 0; i < probes.size(); ++i) {
+    ASSERT_EQ(ranks[i], std::lower_bound(items.begin(), items.end(),
+                                         probes[i]) -
+                            items.begin());
+  }
+
+  const std::vector<double> fractions = {0.5, 0.0, 1.0, 0.25, 0.999, 0.5};
+  const std::vector<T> quantiles = oracle.Quantiles(fractions);
+  for (size_t i = 0; i < fractions.size(); ++i) {
+    const double target = std::ceil(fractions[i] * items.size());
+    const size_t index = std::max(target, 1.0) - 1;
+    ASSERT_EQ(quantiles[i], items[index]) << fractions[i];
+  }
+}
+
+TEST(ExactQuantileOracleTest, NumericRuns) {
+  // A 64 KiB budget over 4 threads makes runs of about 1600 items.
+  ExactQuantileOracle<uint64_t> oracle(
+      {.memory_bytes = 64 << 10, .threads = 4});
+  std::mt19937_64 gen(19);
+  std::vector<uint64_t> items(100'000);
+  for (auto &item : items) {
+    item = gen() % 50'000;
+  }
+  ExpectExact(oracle, items, {0, 1, 25'000, 49'999, 50'000, 7, 7});
+  ASSERT_GT(oracle.Runs(), 50);
+}
+
+TEST(ExactQuantileOracleTest, StringRuns) {
+  ExactQuantileOracle<std::string> oracle(
+      {.memory_bytes = 64 << 10, .threads = 2});
+  std::mt19937_64 gen(23);
+  std::vector<std::string> items(20'000);
+  for (auto &item : items) {
+    // Some keys long enough to live on the heap.
+    item = std::string(gen() % 40, 'k') + std::to_string(gen() % 5000);
+  }
+  ExpectExact(oracle, items, {"", "k", "k5", "kkkk9", "zzz"});
+  ASSERT_GT(oracle.Runs(), 1);
+}
+
+TEST(ExactQuantileOracleTest, IntermediateMerges) {
+  // A 16 KiB budget opens 3 runs per merge, far fewer than the 20 written.
+  ExactQuantileOracle<uint64_t> oracle(
+      {.memory_bytes = 16 << 10, .threads = 1});
+  std::mt19937_64 gen(29);
+  std::vector<uint64_t> items(20'000);
+  for (auto &item : items) {
+    item = gen() % 10'000;
+  }
+  ExpectExact(oracle, items, {0, 5'000, 9'999, 10'000});
+  ASSERT_GE(oracle.Runs(), 20);
+  ASSERT_GT(oracle.IntermediateMerges(), 0);
+}
+
+TEST(ExactQuantileOracleTest, TruncatedRun) {
+  char directory[] = "/tmp/exact-oracle-test-XXXXXX";
+  ASSERT_NE(::mkdtemp(directory), nullptr);
+  {
+    ExactQuantileOracle<uint64_t> oracle({.directory = directory});
+    std::vector<uint64_t> items(1000, 7);
+    oracle.Add(items.begin(), items.end());
+    oracle.Finish();
+    // Cut the only run off in the middle of its last item.
+    for (const auto &entry : std::filesystem::directory_iterator(directory)) {
+      const auto size = std::filesystem::file_size(entry.path());
+      std::filesystem::resize_file(entry.path(), size - 3);
+    }
+    ASSERT_THROW(oracle.Quantiles({1.0}), std::system_error);
+  }
+  std::filesystem::remove_all(directory);
+}
+
+TEST(ExactQuantileOracleTest, UnwritableDirectory) {
+  ExactQuantileOracle<uint64_t> oracle(
+      {.directory = "/nonexistent-directory", .memory_bytes = 1 << 10,
+       .threads = 1});
+  std::vector<uint64_t> items(10'000, 1);
+  ASSERT_THROW(
+      {
+        oracle.Add(items.begin(), items.end());
+        oracle.Finish();
+      },
+      std::system_error);
+}
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <sys/mman.h>
+#include <zlib.h>
+
+#include "bounded_queue.h"
+#include "mapped_file.h"
+#include "relative_error_quantiles_sketch.h"
+
+struct GzipIngestOptions {
+  // Threads inflating input files; each takes a whole file at a time.
+  unsigned decompress_threads = 2;
+  // Threads splitting blocks into keys and inserting them into their own
+  // sketch.
+  unsigned ingest_threads = 2;
+  // Decompressed data is handed over in blocks of about this size, cut at a
+  // newline.
+  uint64_t block_bytes = 1 << 20;
+  // Blocks in flight between the two stages. Decompression stalls when the
+  // ingest threads fall this far behind.
+  uint64_t queue_blocks = 16;
+};
+
+struct GzipIngestResult {
+  uint64_t keys_inserted = 0;
+  uint64_t decompressed_bytes = 0;
+};
+
+// Cuts decompressed data into newline terminated blocks of at least
+// block_bytes and pushes them into the queue. A line longer than a block
+// simply makes its block larger. Once the queue is closed (another thread
+// failed) blocks are dropped and Append() and Finish() return false, so the
+// caller can stop decompressing.
+class LineBlockWriter {
+public:
+  LineBlockWriter(BoundedQueue<std::string> &queue, const uint64_t block_bytes)
+      : queue_(queue), block_bytes_(block_bytes) {
+    block_.reserve(block_bytes_);
+  }
+
+  bool Append(const char *data, const uint64_t size) {
+    if (closed_) {
+      return false;
+    }
+    block_.append(data, size);
+    if (block_.size() >= block_bytes_) {
+      Cut();
+    }
+    return !closed_;
+  }
+
+  // Pushes whatever is left, including a last line without a newline.
+  bool Finish() {
+    if (!block_.empty() && !closed_) {
+      closed_ = !queue_.Push(std::move(block_));
+    }
+    block_.clear();
+    return !closed_;
+  }
+
+private:
+  // Pushes the block up to its last newline and keeps the partial line.
+  void Cut() {
+    const size_t newline = block_.rfind('\n');
+    if (newline == std::string::npos) {
+      return;
+    }
+    std::string rest = block_.substr(newline + 1);
+    block_.resize(newline + 1);
+    closed_ = !queue_.Push(std::move(block_));
+    block_ = std::move(rest);
+    block_.reserve(block_bytes_);
+  }
+
+  BoundedQueue<std::string> &queue_;
+  const uint64_t block_bytes_;
+  std::string block_;
+  bool closed_ = false;
+};
+
+// Inflates a gzip file (one or more concatenated members) into writer and
+// returns the number of bytes produced, stopping early if writer's queue
+// closes. Members can only be found by inflating the one before them, so a
+// single file is always inflated sequentially.
+inline uint64_t InflateGzipFile(const MappedFile &file,
+                                LineBlockWriter &writer,
+                                const std::string &path) {
+  z_stream stream;
+  std::memset(&stream, 0, sizeof(stream));
+  // 15 window bits + 16: gzip wrapper only.
+  if (inflateInit2(&stream, 15 + 16) != Z_OK) {
+    throw std::runtime_error("inflateInit2 failed for " + path);
+  }
+  std::vector<char> out(256 << 10);
+  uint64_t total = 0;
+  stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(file.data()));
+  uint64_t remaining = file.size();
+  int status = Z_OK;
+  while (true) {
+    // avail_in is 32 bits, so feed huge files in slices.
+    if (stream.avail_in == 0 && remaining > 0) {
+      stream.avail_in =
+          static_cast<uInt>(std::min<uint64_t>(remaining, 1u << 30));
+      remaining -= stream.avail_in;
+    }
+    stream.next_out = reinterpret_cast<Bytef *>(out.data());
+    stream.avail_out = static_cast<uInt>(out.size());
+    status = inflate(&stream, Z_NO_FLUSH);
+    const uint64_t produced = out.size() - stream.avail_out;
+    total += produced;
+    if (!writer.Append(out.data(), produced)) {
+      break;
+    }
+
+    if (status == Z_STREAM_END) {
+      if (stream.avail_in == 0 && remaining == 0) {
+        break;
+      }
+      // Another member follows.
+      inflateReset(&stream);
+    } else if (status != Z_OK && status != Z_BUF_ERROR) {
+      inflateEnd(&stream);
+      throw std::runtime_error("corrupt gzip data in " + path);
+    } else if (produced == 0 && stream.avail_in == 0 && remaining == 0) {
+      inflateEnd(&stream);
+      throw std::runtime_error("truncated gzip data in " + path);
+    }
+  }
+  inflateEnd(&stream);
+  return total;
+}
+
+// Sketches newline separated keys from a set of files, gzip-compressed
+// (detected by magic bytes) or plain. Decompression threads take whole
+// files and hand newline aligned blocks through a bounded queue to ingest
+// threads, so inflating and compacting overlap. Each ingest thread fills its
+// own sketch; those are merged into sketch at the end. Empty lines and a
+// trailing '\r' are dropped. Rethrows the first error (std::system_error for
+// unreadable files, std::runtime_error for corrupt gzip data) after all
+// threads have stopped.
+template <typename T>
+GzipIngestResult IngestKeyFiles(const std::vector<std::string> &paths,
+                                RelativeErrorQuantilesSketch<T> &sketch,
+                                const GzipIngestOptions &ingest = {}) {
+  static_assert(std::is_constructible_v<T, std::string_view>,
+                "keys are constructed from the text of each line");
+  BoundedQueue<std::string> blocks(
+      std::max<uint64_t>(ingest.queue_blocks, 1));
+  std::atomic<uint64_t> next_file{0};
+  std::atomic<uint64_t> decompressed_bytes{0};
+  std::mutex error_mutex;
+  std::exception_ptr error;
+  auto fail = [&](std::exception_ptr e) {
+    std::lock_guard<std::mutex> lock(error_mutex);
+    if (!error) {
+      error = e;
+    }
+    blocks.Close();
+  };
+
+  auto decompress = [&] {
+    try {
+      LineBlockWriter writer(blocks, ingest.block_bytes);
+      for (uint64_t i = next_file.fetch_add(1); i < paths.size();
+           i = next_file.fetch_add(1)) {
+        const MappedFile file(paths[i]);
+        file.Advise(0, file.size(), MADV_SEQUENTIAL);
+        const bool gzip = file.size() >= 2 &&
+                          static_cast<uint8_t>(file.data()[0]) == 0x1f &&
+                          static_cast<uint8_t>(file.data()[1]) == 0x8b;
+        if (gzip) {
+          decompressed_bytes += InflateGzipFile(file, writer, paths[i]);
+        } else {
+          writer.Append(file.data(), file.size());
+          decompressed_bytes += file.size();
+        }
+        // Blocks never span files, so a last line without a newline stays
+        // on its own. A closed queue means another thread failed.
+        if (!writer.Finish()) {
+          return;
+        }
+      }
+    } catch (...) {
+      fail(std::current_exception());
+    }
+  };
+
+  std::vector<RelativeErrorQuantilesSketch<T>> sketches(
+      std::max(ingest.ingest_threads, 1u),
+      RelativeErrorQuantilesSketch<T>(sketch.Options()));
+  std::vector<uint64_t> keys(sketches.size(), 0);
+  auto insert = [&](const uint64_t t) {
+    try {
+      std::vector<std::string_view> batch;
+      while (std::optional<std::string> block = blocks.Pop()) {
+        batch.clear();
+        const char *position = block->data();
+        const char *end = block->data() + block->size();
+        while (position < end) {
+          const void *newline = std::memchr(position, '\n', end - position);
+          const char *line_end =
+              newline == nullptr ? end : static_cast<const char *>(newline);
+          std::string_view line(position, line_end - position);
+          if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+          }
+          if (!line.empty()) {
+            batch.push_back(line);
+          }
+          position = line_end + 1;
+        }
+        sketches[t].InsertBatch(batch.begin(), batch.end());
+        keys[t] += batch.size();
+      }
+    } catch (...) {
+      fail(std::current_exception());
+    }
+  };
+
+  std::vector<std::thread> decompressors;
+  for (unsigned t = 0; t < std::max(ingest.decompress_threads, 1u); ++t) {
+    decompressors.emplace_back(decompress);
+  }
+  std::vector<std::thread> inserters;
+  for (uint64_t t = 0; t < sketches.size(); ++t) {
+    inserters.emplace_back(insert, t);
+  }
+  for (auto &thread : decompressors) {
+    thread.join();
+  }
+  blocks.Close();
+  for (auto &thread : inserters) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+
+  GzipIngestResult result;
+  result.decompressed_bytes = decompressed_bytes;
+  for (uint64_t t = 0; t < sketches.size(); ++t) {
+    sketch.Merge(sketches[t]);
+    result.keys_inserted += keys[t];
+  }
+  return result;
+}
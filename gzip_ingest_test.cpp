@@ -0,0 +1,86 @@
+#include "gzip_ingest.h"
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+std::string Gzip(const std::string &text) {
+  z_stream stream;
+  std::memset(&stream, 0, sizeof(stream));
+  deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+               Z_DEFAULT_STRATEGY);
+  std::string out(deflateBound(&stream, text.size()), '\0');
+  stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(text.data()));
+  stream.avail_in = text.size();
+  stream.next_out = reinterpret_cast<Bytef *>(out.data());
+  stream.avail_out = out.size();
+  deflate(&stream, Z_FINISH);
+  out.resize(stream.total_out);
+  deflateEnd(&stream);
+  return out;
+}
+
+std::string WriteFile(const std::string &name, const std::string &contents) {
+  const std::string path = ::testing::TempDir() + name;
+  std::ofstream(path, std::ios::binary | std::ios::trunc) << contents;
+  return path;
+}
+
+std::string Keys(int first, int last) {
+  std::string text;
+  for (int i = first; i < last; ++i) {
+    text += fmt::format("key-{:06}\n", i);
+  }
+  return text;
+}
+
+RelativeErrorQuantilesSketchOptions Options() {
+  return RelativeErrorQuantilesSketchOptions{.n = 1 << 20, .k = 64};
+}
+
+TEST(GzipIngestTest, PlainAndMultiMemberFiles) {
+  // Two gzip members in one file, a single member file, and a plain file
+  // whose last line has no newline and uses CRLF.
+  const std::vector<std::string> paths = {
+      WriteFile("keys-0.gz", Gzip(Keys(0, 30000)) + Gzip(Keys(30000, 50000))),
+      WriteFile("keys-1.gz", Gzip(Keys(50000, 60000))),
+      WriteFile("keys-2.txt", "key-060000\r\n\nkey-060001"),
+  };
+  RelativeErrorQuantilesSketch<std::string> sketch(Options());
+  GzipIngestOptions ingest = {.block_bytes = 4096, .queue_blocks = 4};
+  const GzipIngestResult result = IngestKeyFiles(paths, sketch, ingest);
+  ASSERT_EQ(result.keys_inserted, 60002);
+  sketch.Close();
+  ASSERT_EQ(sketch.TotalWeight(), 60002);
+  ASSERT_EQ(sketch.GetQuantile(0.0), "key-000000");
+  for (const auto &path : paths) {
+    std::remove(path.c_str());
+  }
+}
+
+TEST(GzipIngestTest, CorruptFile) {
+  std::string data = Gzip(Keys(0, 1000));
+  data.resize(data.size() / 2);
+  const std::string path = WriteFile("truncated.gz", data);
+  RelativeErrorQuantilesSketch<std::string> sketch(Options());
+  ASSERT_THROW(IngestKeyFiles(std::vector<std::string>{path}, sketch),
+               std::runtime_error);
+  std::remove(path.c_str());
+}
+
+TEST(GzipIngestTest, StopsWhenQueueCloses) {
+  const std::string text = Keys(0, 100000);
+  const std::string path = WriteFile("closed.gz", Gzip(text));
+  const MappedFile file(path);
+  BoundedQueue<std::string> queue(4);
+  queue.Close();
+  LineBlockWriter writer(queue, 1024);
+  // Nothing consumes the blocks, so inflating stops after the first output
+  // buffer instead of running through the file.
+  ASSERT_LT(InflateGzipFile(file, writer, path), text.size());
+  ASSERT_FALSE(writer.Append("key\n", 4));
+  ASSERT_FALSE(writer.Finish());
+  std::remove(path.c_str());
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fmt/format.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// What InlineString does with a string longer than its capacity.
+enum class InlineStringOverflow {
+  // Throw std::length_error.
+  kThrow,
+  // Keep the first N bytes and mark the key as truncated.
+  kTruncate,
+};
+
+// String key stored inline: a length byte followed by N bytes, zero padded.
+// Unlike std::string, keys just past the small string limit need no heap
+// allocation, so compactor buffers of InlineString are flat arrays that sort
+// by swapping a few cache lines and compare without chasing pointers.
+//
+// Ordering is the same as std::string's (bytewise, unsigned). Because the
+// padding is zero, comparing all N bytes with one fixed size memcmp and then
+// the lengths gives that order, and the compiler can inline the memcmp.
+//
+// With kTruncate, a truncated key stores length N + 1, so it sorts right
+// after the exact key made of the same N bytes and before every key with a
+// larger prefix. Truncation never reorders keys, it only ties keys that
+// share their first N bytes.
+template <uint64_t N,
+          InlineStringOverflow Overflow = InlineStringOverflow::kThrow>
+class InlineString {
+  static_assert(N > 0 && N <= 255, "the length must fit in one byte");
+  static_assert(Overflow == InlineStringOverflow::kThrow || N <= 254,
+                "truncated keys need length N + 1 to fit in one byte");
+
+public:
+  InlineString() : size_(0), data_{} {}
+
+  explicit InlineString(const std::string_view value) : data_{} {
+    if (value.size() > N) {
+      if constexpr (Overflow == InlineStringOverflow::kThrow) {
+        throw std::length_error("key of " + std::to_string(value.size()) +
+                                " bytes does not fit InlineString<" +
+                                std::to_string(N) + ">");
+      }
+      size_ = N + 1;
+      std::memcpy(data_, value.data(), N);
+      return;
+    }
+    size_ = static_cast<uint8_t>(value.size());
+    std::memcpy(data_, value.data(), value.size());
+  }
+
+  InlineString &operator=(const std::string_view value) {
+    return *this = InlineString(value);
+  }
+
+  static constexpr uint64_t capacity() { return N; }
+  // Number of stored bytes, at most N.
+  [[nodiscard]] uint64_t size() const { return size_ > N ? N : size_; }
+  // Whether the key was cut at N bytes (kTruncate only).
+  [[nodiscard]] bool truncated() const { return size_ > N; }
+  [[nodiscard]] bool empty() const { return size_ == 0; }
+  [[nodiscard]] const char *data() const { return data_; }
+  [[nodiscard]] std::string_view view() const {
+    return std::string_view(data_, size());
+  }
+  [[nodiscard]] std::string str() const { return std::string(view()); }
+
+  friend bool operator==(const InlineString &a, const InlineString &b) {
+    return a.size_ == b.size_ && std::memcmp(a.data_, b.data_, N) == 0;
+  }
+  friend bool operator!=(const InlineString &a, const InlineString &b) {
+    return !(a == b);
+  }
+  friend bool operator<(const InlineString &a, const InlineString &b) {
+    const int order = std::memcmp(a.data_, b.data_, N);
+    return order < 0 || (order == 0 && a.size_ < b.size_);
+  }
+  friend bool operator>(const InlineString &a, const InlineString &b) {
+    return b < a;
+  }
+  friend bool operator<=(const InlineString &a, const InlineString &b) {
+    return !(b < a);
+  }
+  friend bool operator>=(const InlineString &a, const InlineString &b) {
+    return !(a < b);
+  }
+
+private:
+  uint8_t size_;
+  char data_[N];
+};
+
+// Keys whose memory per item is bounded regardless of input length: long
+// keys (URLs, paths) keep their first P bytes, which is all the precision
+// quantile boundaries usually need.
+//
+// Rank semantics. Every key longer than P collapses into one truncated key
+// per P-byte prefix, which is a tie. A query of at most P bytes gets the
+// same rank it would get from a sketch of the full keys. A longer query is
+// truncated too, so its rank counts the items below its whole prefix group:
+// the full-key rank lies between that value and that value plus the
+// group's weight. Quantiles come back as the truncated prefix of the
+// quantile item.
+template <uint64_t P>
+using TruncatedPrefixKey = InlineString<P, InlineStringOverflow::kTruncate>;
+
+// Formats the stored bytes; truncated keys print their prefix.
+template <uint64_t N, InlineStringOverflow Overflow>
+struct fmt::formatter<InlineString<N, Overflow>>
+    : fmt::formatter<std::string_view> {
+  template <typename FormatContext>
+  auto format(const InlineString<N, Overflow> &value,
+              FormatContext &ctx) const {
+    return fmt::formatter<std::string_view>::format(value.view(), ctx);
+  }
+};
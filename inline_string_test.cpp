@@ -0,0 +1,104 @@
+#include "inline_string.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "relative_error_quantiles_sketch.h"
+
+static_assert(std::is_trivially_copyable_v<InlineString<24>>);
+static_assert(sizeof(InlineString<31>) == 32);
+
+TEST(InlineStringTest, OrdersLikeStdString) {
+  // Short alphabets with '\0' and high bytes, so prefixes and padding
+  // collide often.
+  std::mt19937 gen(11);
+  const std::string alphabet = std::string("a\0\x01\xff", 4);
+  std::vector<std::string> strings;
+  for (int i = 0; i < 500; ++i) {
+    std::string s(gen() % 6, 'a');
+    for (auto &c : s) {
+      c = alphabet[gen() % alphabet.size()];
+    }
+    strings.push_back(s);
+  }
+  for (const auto &a : strings) {
+    for (const auto &b : strings) {
+      const InlineString<8> x(a);
+      const InlineString<8> y(b);
+      ASSERT_EQ(x < y, a < b);
+      ASSERT_EQ(x == y, a == b);
+      ASSERT_EQ(x > y, a > b);
+    }
+  }
+}
+
+TEST(InlineStringTest, Overflow) {
+  ASSERT_EQ(InlineString<4>("abcd").view(), "abcd");
+  ASSERT_THROW(InlineString<4>("abcde"), std::length_error);
+}
+
+TEST(InlineStringTest, Format) {
+  ASSERT_EQ(fmt::format("[{}]", InlineString<16>("key-1")), "[key-1]");
+  ASSERT_EQ(fmt::format("[{:>6}]", InlineString<16>("ab")), "[    ab]");
+}
+
+TEST(InlineStringTest, SketchKeys) {
+  RelativeErrorQuantilesSketchOptions options = {.n = 1 << 16, .k = 16};
+  RelativeErrorQuantilesSketch<InlineString<24>> sketch(options);
+  std::vector<std::string> keys;
+  for (int i = 100; i >= 1; --i) {
+    keys.push_back(fmt::format("key-{:03}", i));
+  }
+  std::vector<std::string_view> views(keys.begin(), keys.end());
+  sketch.InsertBatch(views.begin(), views.end());
+  sketch.Close();
+  ASSERT_EQ(sketch.TotalWeight(), 100);
+  ASSERT_EQ(sketch.GetQuantile(0.0).view(), "key-001");
+  ASSERT_EQ(sketch.GetQuantile(0.5).view(), "key-050");
+  ASSERT_EQ(sketch.EstimateRank(InlineString<24>("key-051")), 50);
+}
+
+TEST(InlineStringTest, TruncatedKeysTieAfterTheirPrefix) {
+  using Key = TruncatedPrefixKey<4>;
+  const Key exact("abcd");
+  const Key long_key("abcdzzz");
+  ASSERT_FALSE(exact.truncated());
+  ASSERT_TRUE(long_key.truncated());
+  ASSERT_EQ(long_key.view(), "abcd");
+  ASSERT_EQ(fmt::format("{}", long_key), "abcd");
+  ASSERT_EQ(long_key, Key("abcdaaaa"));
+  ASSERT_LT(Key("abc"), exact);
+  ASSERT_LT(exact, long_key);
+  ASSERT_LT(long_key, Key("abce"));
+  ASSERT_LT(Key("abcc\xff\xff"), exact);
+}
+
+TEST(InlineStringTest, TruncatedPrefixRanks) {
+  // Paths under three directories; the sketch keeps the first 8 bytes.
+  std::vector<std::string> paths;
+  for (const std::string directory : {"/a/", "/bin/", "/usr/lib/"}) {
+    for (int i = 0; i < 30; ++i) {
+      paths.push_back(fmt::format("{}file-{:02}", directory, i));
+    }
+  }
+  RelativeErrorQuantilesSketchOptions options = {.n = 1 << 16, .k = 16};
+  RelativeErrorQuantilesSketch<TruncatedPrefixKey<8>> sketch(options);
+  std::vector<std::string_view> views(paths.begin(), paths.end());
+  sketch.InsertBatch(views.begin(), views.end());
+  sketch.Close();
+  ASSERT_EQ(sketch.TotalWeight(), 90);
+
+  // Short queries get exact ranks.
+  ASSERT_EQ(sketch.EstimateRank(TruncatedPrefixKey<8>("/bin/")), 30);
+  ASSERT_EQ(sketch.EstimateRank(TruncatedPrefixKey<8>("/c")), 60);
+  // A long query ranks at the start of its prefix group: "/a/file-" holds
+  // all of /a/, "/usr/lib" all of /usr/lib/.
+  ASSERT_EQ(sketch.EstimateRank(TruncatedPrefixKey<8>("/a/file-17")), 0);
+  ASSERT_EQ(sketch.EstimateRank(TruncatedPrefixKey<8>("/usr/lib/x")), 60);
+  ASSERT_EQ(sketch.GetQuantile(0.5).view(), "/bin/fil");
+  ASSERT_TRUE(sketch.GetQuantile(0.5).truncated());
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Moves every other item of [first, first + count), starting with first[0],
+// into out. out must have room for (count + 1) / 2 items. The source items
+// are left in a moved-from state.
+template <typename T>
+void ExtractAlternate(T *first, const uint64_t count, T *out) {
+  uint64_t i = 0;
+  uint64_t j = 0;
+#if defined(__AVX2__)
+  if constexpr (std::is_trivially_copyable_v<T> && sizeof(T) == 8) {
+    // a0 a1 a2 a3 | b0 b1 b2 b3 -> a0 b0 a2 b2 -> a0 a2 b0 b2
+    for (; i + 8 <= count; i += 8, j += 4) {
+      const __m256i a =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first + i));
+      const __m256i b =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first + i + 4));
+      const __m256i even = _mm256_permute4x64_epi64(
+          _mm256_unpacklo_epi64(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + j), even);
+    }
+  } else if constexpr (std::is_trivially_copyable_v<T> && sizeof(T) == 4) {
+    // Gather the even lanes of each vector into its low half, then join the
+    // two low halves.
+    const __m256i index = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    for (; i + 16 <= count; i += 16, j += 8) {
+      const __m256i a = _mm256_permutevar8x32_epi32(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first + i)),
+          index);
+      const __m256i b = _mm256_permutevar8x32_epi32(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first + i + 8)),
+          index);
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + j),
+                          _mm256_permute2x128_si256(a, b, 0x20));
+    }
+  }
+#endif
+  for (; i < count; i += 2, ++j) {
+    out[j] = std::move(first[i]);
+  }
+}
+
+// In-place inclusive prefix sum. Sums are formed in a different order than a
+// sequential loop, which is exact for the power of two weights the sketch
+// produces.
+inline void PrefixSum(double *data, const uint64_t count) {
+  uint64_t i = 0;
+  double carry = 0.0;
+#if defined(__AVX2__)
+  const __m256d zero = _mm256_setzero_pd();
+  __m256d carry_vector = zero;
+  for (; i + 4 <= count; i += 4) {
+    // [a b c d] + [0 a b c] = [a a+b b+c c+d]
+    __m256d x = _mm256_loadu_pd(data + i);
+    x = _mm256_add_pd(
+        x, _mm256_blend_pd(
+               _mm256_permute4x64_pd(x, _MM_SHUFFLE(2, 1, 0, 0)), zero, 1));
+    // + [0 0 a a+b] = [a a+b a+b+c a+b+c+d]
+    x = _mm256_add_pd(x, _mm256_permute2f128_pd(x, x, 0x08));
+    x = _mm256_add_pd(x, carry_vector);
+    _mm256_storeu_pd(data + i, x);
+    carry_vector = _mm256_permute4x64_pd(x, _MM_SHUFFLE(3, 3, 3, 3));
+  }
+  carry = _mm256_cvtsd_f64(carry_vector);
+#endif
+  for (; i < count; ++i) {
+    carry += data[i];
+    data[i] = carry;
+  }
+}
+
+// Index of the first element of the sorted array data that is not less than
+// value, as std::lower_bound. The loop has a fixed trip count for a given
+// size and selects the next half with a conditional move, and prefetches both
+// candidate midpoints of the next step so large arrays stay
+// memory-parallel.
+template <typename T>
+uint64_t BranchlessLowerBound(const T *data, uint64_t count, const T &value) {
+  if (count == 0) {
+    return 0;
+  }
+  const T *base = data;
+  while (count > 1) {
+    const uint64_t half = count / 2;
+    if constexpr (std::is_arithmetic_v<T>) {
+      __builtin_prefetch(base + half / 2);
+      __builtin_prefetch(base + half + half / 2);
+    }
+    base = base[half - 1] < value ? base + half : base;
+    count -= half;
+  }
+  return (base - data) + (*base < value ? 1 : 0);
+}
+
+// Whether the sketch's EstimateRank() searches keys of type T with
+// InterpolationLowerBound. It only pays off when keys are spread evenly
+// (uniform ids, hashes), and costs up to twice a binary search on skewed
+// ones (log-normal latencies), so it is off unless a program opts an
+// arithmetic key type in:
+//   template <> struct UseInterpolationSearch<uint64_t> : std::true_type {};
+template <typename T> struct UseInterpolationSearch : std::false_type {};
+
+// Index of the first element of the sorted array data that is not less than
+// value, as std::lower_bound, for arithmetic T. Each round guesses the
+// position from where value falls between the ends of the remaining range,
+// then probes sqrt(range) past the guess to bracket the answer on both
+// sides: on smooth (e.g. uniform) keys the guess is about that close, so
+// the range shrinks from n to sqrt(n) per round and a lookup takes
+// O(log log n) rounds. A round that fails to halve the range is followed by
+// a bisection step, so skewed keys cost at most about three times the
+// probes of a binary search. Short ranges finish with BranchlessLowerBound.
+template <typename T>
+uint64_t InterpolationLowerBound(const T *data, const uint64_t count,
+                                 const T &value) {
+  static_assert(std::is_arithmetic_v<T>, "interpolation needs numeric keys");
+  // The answer lies in [low, high].
+  uint64_t low = 0;
+  uint64_t high = count;
+  bool interpolate = true;
+  while (high - low > 16) {
+    const uint64_t before = high - low;
+    if (!interpolate) {
+      const uint64_t probe = low + before / 2;
+      if (data[probe] < value) {
+        low = probe + 1;
+      } else {
+        high = probe;
+      }
+      interpolate = true;
+      continue;
+    }
+    if (!(data[low] < value)) {
+      return low;
+    }
+    if (data[high - 1] < value) {
+      return high;
+    }
+    // data[low] < value <= data[high - 1].
+    const double first = static_cast<double>(data[low]);
+    const double fraction = (static_cast<double>(value) - first) /
+                            (static_cast<double>(data[high - 1]) - first);
+    uint64_t probe = low + before / 2;
+    if (fraction >= 0.0 && fraction <= 1.0) {
+      probe = low + static_cast<uint64_t>(fraction * (before - 1));
+    }
+    const uint64_t reach =
+        static_cast<uint64_t>(std::sqrt(static_cast<double>(before)));
+    if (data[probe] < value) {
+      low = probe + 1;
+      if (probe + reach < high) {
+        if (data[probe + reach] < value) {
+          low = probe + reach + 1;
+        } else {
+          high = probe + reach;
+        }
+      }
+    } else {
+      high = probe;
+      if (probe >= low + reach) {
+        if (data[probe - reach] < value) {
+          low = probe - reach + 1;
+        } else {
+          high = probe - reach;
+        }
+      }
+    }
+    interpolate = high - low <= before / 2;
+  }
+  return low + BranchlessLowerBound(data + low, high - low, value);
+}
@@ -0,0 +1,114 @@
+#include "kernels.h"
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+template <typename T> void ExpectAlternate(const uint64_t count) {
+  std::vector<T> items(count);
+  std::iota(items.begin(), items.end(), T{0});
+  std::vector<T> out((count + 1) / 2);
+  ExtractAlternate(items.data(), count, out.data());
+  for (uint64_t j = 0; j < out.size(); ++j) {
+    ASSERT_EQ(out[j], static_cast<T>(2 * j));
+  }
+}
+
+TEST(KernelsTest, ExtractAlternateNumeric) {
+  // Counts around the vector widths exercise both the SIMD body and the
+  // scalar tail.
+  for (uint64_t count = 0; count < 70; ++count) {
+    ExpectAlternate<uint64_t>(count);
+    ExpectAlternate<double>(count);
+    ExpectAlternate<int32_t>(count);
+    ExpectAlternate<float>(count);
+    ExpectAlternate<uint16_t>(count);
+  }
+}
+
+TEST(KernelsTest, ExtractAlternateStrings) {
+  std::vector<std::string> items = {"a", "b", "c", "d", "e"};
+  std::vector<std::string> out(3);
+  ExtractAlternate(items.data(), items.size(), out.data());
+  ASSERT_EQ(out, (std::vector<std::string>{"a", "c", "e"}));
+}
+
+TEST(KernelsTest, PrefixSum) {
+  for (uint64_t count = 0; count < 20; ++count) {
+    std::vector<double> data(count);
+    for (uint64_t i = 0; i < count; ++i) {
+      data[i] = static_cast<double>(1 << (i % 5));
+    }
+    std::vector<double> expected(count);
+    std::partial_sum(data.begin(), data.end(), expected.begin());
+    PrefixSum(data.data(), data.size());
+    ASSERT_EQ(data, expected);
+  }
+}
+
+TEST(KernelsTest, BranchlessLowerBound) {
+  const std::vector<double> data = {1.0, 2.0, 2.0, 4.0, 8.0, 8.0, 9.0};
+  for (double value = 0.0; value <= 10.0; value += 0.5) {
+    const auto expected =
+        std::lower_bound(data.begin(), data.end(), value) - data.begin();
+    ASSERT_EQ(BranchlessLowerBound(data.data(), data.size(), value), expected);
+  }
+  ASSERT_EQ(BranchlessLowerBound(data.data(), 0, 1.0), 0);
+}
+
+template <typename T>
+void ExpectInterpolationLowerBound(const std::vector<T> &data,
+                                   const std::vector<T> &probes) {
+  for (const T value : probes) {
+    const auto expected =
+        std::lower_bound(data.begin(), data.end(), value) - data.begin();
+    ASSERT_EQ(InterpolationLowerBound(data.data(), data.size(), value),
+              expected)
+        << value;
+  }
+}
+
+TEST(KernelsTest, InterpolationLowerBound) {
+  std::mt19937_64 gen(13);
+  std::vector<uint64_t> uniform(10000);
+  for (auto &value : uniform) {
+    value = gen() % 50000;
+  }
+  std::sort(uniform.begin(), uniform.end());
+  std::vector<uint64_t> probes = {0, UINT64_MAX};
+  for (int i = 0; i < 10000; ++i) {
+    probes.push_back(gen() % 60000);
+  }
+  ExpectInterpolationLowerBound(uniform, probes);
+
+  // Exponentially spaced keys defeat interpolation; the bisection steps
+  // keep the search bounded and correct.
+  std::vector<double> skewed;
+  for (int i = 0; i < 2000; ++i) {
+    skewed.push_back(std::pow(1.02, i));
+  }
+  std::vector<double> skewed_probes = {-1.0, 0.0, 1e300};
+  for (int i = 0; i < 2000; ++i) {
+    skewed_probes.push_back(skewed[i]);
+    skewed_probes.push_back(skewed[i] * 1.01);
+  }
+  ExpectInterpolationLowerBound(skewed, skewed_probes);
+
+  // Long runs of duplicates and full-range signed values.
+  std::vector<int64_t> runs;
+  for (int64_t i = -50; i < 50; ++i) {
+    runs.insert(runs.end(), 37, i * (INT64_MAX / 64));
+  }
+  std::vector<int64_t> run_probes = {INT64_MIN, INT64_MAX};
+  for (int64_t i = -51; i <= 51; ++i) {
+    run_probes.push_back(i * (INT64_MAX / 64));
+    run_probes.push_back(i * (INT64_MAX / 64) + 1);
+  }
+  ExpectInterpolationLowerBound(runs, run_probes);
+  ExpectInterpolationLowerBound(std::vector<int>(), std::vector<int>{1});
+}
@@ -1,61 +1,308 @@
 #include <algorithm>
-#include <bit>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cinttypes>
 #include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
 #include <fmt/core.h>
 #include <fstream>
 #include <functional>
-#include <iostream>
 #include <map>
+#include <mutex>
 #include <random>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
+#include <unistd.h>
+
 #include "relative_error_quantiles_sketch.h"
 
-#define Type std::string
-
-std::string GenerateKey() {
-  static std::random_device rd;
-  static std::mt19937_64 gen(rd());
-  static std::uniform_int_distribution<uint64_t> distrib(
-      0, std::numeric_limits<uint64_t>::max());
-
-  uint64_t r1 = distrib(gen);
-  uint64_t r2 = distrib(gen);
-  uint64_t r3 = distrib(gen);
-  uint64_t r4 = distrib(gen);
-  uint64_t r5 = distrib(gen);
-  return fmt::format("{:016x}:{:016x}:{:016x}:{:016x}:{:016x}", r1, r2, r3, r4,
-                     r5);
+// Synthetic load generator. Producer threads each fill their own sketch with
+// keys drawn from a distribution; a reporter thread prints throughput,
+// compaction rate, sketch memory and resident memory once per interval, and
+// the sketches are merged at the end.
+//
+//   streaming-quantiles [--threads N] [--keys N] [--type string|uint64|double]
+//                       [--distribution uniform|sequential|lognormal|pareto]
+//                       [--k K] [--n N] [--staging S] [--interval-ms MS]
+
+struct LoadOptions {
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  uint64_t keys = 1'000'000'000;
+  std::string type = "string";
+  std::string distribution = "uniform";
+  // Must be an even integer
+  uint64_t k = 16384;
+  // Rough estimate of the number of elements in the input set; defaults to
+  // keys.
+  uint64_t n = 0;
+  uint64_t staging = 0;
+  uint64_t interval_ms = 1000;
+};
+
+// Draws raw 64-bit values from the selected distribution. Numeric key types
+// use the value directly; string keys put it in their leading field.
+class ValueSource {
+public:
+  ValueSource(const std::string &distribution, const uint64_t seed,
+              const uint64_t first)
+      : distribution_(distribution), generator_(seed), next_(first) {}
+
+  void Fill(uint64_t *values, const uint64_t count) {
+    if (distribution_ == "uniform") {
+      for (uint64_t i = 0; i < count; ++i) {
+        values[i] = generator_();
+      }
+    } else if (distribution_ == "sequential") {
+      for (uint64_t i = 0; i < count; ++i) {
+        values[i] = next_++;
+      }
+    } else if (distribution_ == "lognormal") {
+      // Latency-like values in microseconds.
+      std::lognormal_distribution<double> lognormal(8.0, 1.5);
+      for (uint64_t i = 0; i < count; ++i) {
+        values[i] = static_cast<uint64_t>(lognormal(generator_));
+      }
+    } else {
+      // Pareto with shape 1.2: a few huge values, many small ones.
+      std::uniform_real_distribution<double> uniform(0.0, 1.0);
+      for (uint64_t i = 0; i < count; ++i) {
+        values[i] = static_cast<uint64_t>(
+            std::min(1e18, std::pow(1.0 - uniform(generator_), -1.0 / 1.2)));
+      }
+    }
+  }
+
+  std::mt19937_64 &Generator() { return generator_; }
+
+private:
+  const std::string distribution_;
+  std::mt19937_64 generator_;
+  uint64_t next_;
+};
+
+// Two hex digits per byte value, so a 64-bit word formats with eight table
+// lookups instead of a trip through fmt::format.
+constexpr std::array<char, 512> MakeHexTable() {
+  std::array<char, 512> table = {};
+  constexpr char kDigits[] = "0123456789abcdef";
+  for (int i = 0; i < 256; ++i) {
+    table[2 * i] = kDigits[i >> 4];
+    table[2 * i + 1] = kDigits[i & 15];
+  }
+  return table;
 }
+constexpr std::array<char, 512> kHexTable = MakeHexTable();
 
-uint32_t GenerateInt() {
-  static std::random_device rd;
-  static std::mt19937_64 gen(rd());
-  static std::uniform_int_distribution<uint64_t> distrib(
-      0, std::numeric_limits<uint64_t>::max());
-  return distrib(gen);
+inline void FormatHex(uint64_t value, char *out) {
+  for (int i = 7; i >= 0; --i) {
+    std::memcpy(out + 2 * i, &kHexTable[2 * (value & 0xff)], 2);
+    value >>= 8;
+  }
 }
 
-int main(int argc, char **argv) {
-  RelativeErrorQuantilesSketchOptions options = {
-      // Rough estimate of the number of elements in input set.
-      .n = 1'000'000'000,
-      // Must be an even integer
-      .k = 16384};
+// "{:016x}:{:016x}:{:016x}:{:016x}:{:016x}", the key format of the original
+// driver.
+constexpr uint64_t kStringKeySize = 5 * 16 + 4;
+
+inline void FormatStringKey(const uint64_t leading, std::mt19937_64 &generator,
+                            char *out) {
+  FormatHex(leading, out);
+  for (int word = 1; word < 5; ++word) {
+    out[17 * word - 1] = ':';
+    FormatHex(generator(), out + 17 * word);
+  }
+}
+
+// Resident set size from /proc/self/statm, in bytes.
+uint64_t ResidentBytes() {
+  std::ifstream statm("/proc/self/statm");
+  uint64_t size = 0;
+  uint64_t resident = 0;
+  statm >> size >> resident;
+  return resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+}
+
+// Per-producer progress, published after every batch for the reporter.
+struct alignas(64) Progress {
+  std::atomic<uint64_t> inserted{0};
+  std::atomic<uint64_t> compactions{0};
+  std::atomic<uint64_t> sketch_bytes{0};
+};
+
+template <typename T> void Run(const LoadOptions &load) {
+  const RelativeErrorQuantilesSketchOptions options = {
+      .n = load.n > 0 ? load.n : load.keys,
+      .k = load.k,
+      .staging_size = load.staging};
   assert(options.k % 2 == 0);
 
-  RelativeErrorQuantilesSketch<Type> sketch(options);
+  std::vector<RelativeErrorQuantilesSketch<T>> sketches(
+      load.threads, RelativeErrorQuantilesSketch<T>(options));
+  std::vector<Progress> progress(load.threads);
+
+  auto produce = [&](const unsigned t) {
+    constexpr uint64_t kBatchSize = 4096;
+    const uint64_t first = load.keys * t / load.threads;
+    const uint64_t last = load.keys * (t + 1) / load.threads;
+    ValueSource source(load.distribution, 42 + t, first);
+    std::vector<uint64_t> values(kBatchSize);
+    // String keys are formatted into one reused arena and inserted as views.
+    std::vector<char> arena;
+    std::vector<std::string_view> views;
+    if constexpr (std::is_same_v<T, std::string>) {
+      arena.resize(kBatchSize * kStringKeySize);
+      views.resize(kBatchSize);
+    }
+    std::vector<T> batch;
+
+    for (uint64_t done = first; done < last;) {
+      const uint64_t count = std::min(kBatchSize, last - done);
+      source.Fill(values.data(), count);
+      if constexpr (std::is_same_v<T, std::string>) {
+        for (uint64_t i = 0; i < count; ++i) {
+          char *key = arena.data() + i * kStringKeySize;
+          FormatStringKey(values[i], source.Generator(), key);
+          views[i] = std::string_view(key, kStringKeySize);
+        }
+        sketches[t].InsertBatch(views.begin(), views.begin() + count);
+      } else {
+        batch.assign(values.begin(), values.begin() + count);
+        sketches[t].InsertBatch(batch.begin(), batch.end());
+      }
+      done += count;
+      progress[t].inserted.store(done - first, std::memory_order_relaxed);
+      progress[t].compactions.store(sketches[t].Compactions(),
+                                    std::memory_order_relaxed);
+      progress[t].sketch_bytes.store(sketches[t].MemoryUsage().total_bytes,
+                                     std::memory_order_relaxed);
+    }
+  };
+
+  std::mutex mutex;
+  std::condition_variable stopped;
+  bool stop = false;
+  const auto start = std::chrono::steady_clock::now();
+  auto report = [&] {
+    uint64_t last_inserted = 0;
+    uint64_t last_compactions = 0;
+    auto last_time = start;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopped.wait_for(lock,
+                             std::chrono::milliseconds(load.interval_ms),
+                             [&] { return stop; })) {
+      uint64_t inserted = 0;
+      uint64_t compactions = 0;
+      uint64_t sketch_bytes = 0;
+      for (const auto &p : progress) {
+        inserted += p.inserted.load(std::memory_order_relaxed);
+        compactions += p.compactions.load(std::memory_order_relaxed);
+        sketch_bytes += p.sketch_bytes.load(std::memory_order_relaxed);
+      }
+      const auto now = std::chrono::steady_clock::now();
+      const double seconds =
+          std::chrono::duration<double>(now - last_time).count();
+      fmt::print("{:>7.1f}s {:>12} keys {:>8.2f} Minserts/s {:>10.0f} "
+                 "compactions/s {:>8.1f} MiB sketches {:>8.1f} MiB RSS\n",
+                 std::chrono::duration<double>(now - start).count(), inserted,
+                 (inserted - last_inserted) / seconds / 1e6,
+                 (compactions - last_compactions) / seconds,
+                 sketch_bytes / 1048576.0, ResidentBytes() / 1048576.0);
+      last_inserted = inserted;
+      last_compactions = compactions;
+      last_time = now;
+    }
+  };
+
+  fmt::print("Attempting to insert {} {} keys ({}) on {} threads\n", load.keys,
+             load.type, load.distribution, load.threads);
+  std::thread reporter(report);
+  std::vector<std::thread> producers;
+  for (unsigned t = 0; t < load.threads; ++t) {
+    producers.emplace_back(produce, t);
+  }
+  for (auto &producer : producers) {
+    producer.join();
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop = true;
+  }
+  stopped.notify_one();
+  reporter.join();
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+
+  for (unsigned t = 1; t < load.threads; ++t) {
+    sketches[0].Merge(sketches[t]);
+  }
+  sketches[0].Close();
+  fmt::print("Inserted {} keys in {:.2f}s, {:.2f} Minserts/s, {} retained, "
+             "{:.1f} MiB RSS\n",
+             load.keys, seconds, load.keys / seconds / 1e6,
+             sketches[0].RetainedItems(), ResidentBytes() / 1048576.0);
+  if (load.keys > 0) {
+    fmt::print("p50 {} p99 {}\n", sketches[0].GetQuantile(0.5),
+               sketches[0].GetQuantile(0.99));
+  }
+}
+
+int main(int argc, char **argv) {
+  LoadOptions load;
+  const std::map<std::string, std::function<void(const char *)>> flags = {
+      {"--threads",
+       [&](const char *v) { load.threads = std::max(1, std::atoi(v)); }},
+      {"--keys",
+       [&](const char *v) { load.keys = std::strtoull(v, nullptr, 10); }},
+      {"--type", [&](const char *v) { load.type = v; }},
+      {"--distribution", [&](const char *v) { load.distribution = v; }},
+      {"--k", [&](const char *v) { load.k = std::strtoull(v, nullptr, 10); }},
+      {"--n", [&](const char *v) { load.n = std::strtoull(v, nullptr, 10); }},
+      {"--staging",
+       [&](const char *v) { load.staging = std::strtoull(v, nullptr, 10); }},
+      {"--interval-ms",
+       [&](const char *v) {
+         load.interval_ms = std::strtoull(v, nullptr, 10);
+       }},
+  };
+  bool valid = argc % 2 == 1;
+  for (int i = 1; valid && i + 1 < argc; i += 2) {
+    const auto flag = flags.find(argv[i]);
+    valid = flag != flags.end();
+    if (valid) {
+      flag->second(argv[i + 1]);
+    }
+  }
+  const std::vector<std::string> distributions = {"uniform", "sequential",
+                                                  "lognormal", "pareto"};
+  valid = valid && load.k > 0 && load.k % 2 == 0 && load.interval_ms >= 1 &&
+          std::find(distributions.begin(), distributions.end(),
+                    load.distribution) != distributions.end();
+  if (!valid) {
+    fmt::print("Usage: {} [--threads N] [--keys N] "
+               "[--type string|uint64|double]\n"
+               "  [--distribution uniform|sequential|lognormal|pareto] "
+               "[--k K] [--n N] [--staging S] [--interval-ms MS]\n",
+               argv[0]);
+    return 1;
+  }
 
-  fmt::print("Attempting to insert {} keys\n", options.n);
-  std::vector<Type> keys;
-  for (uint64_t i = 0; i < options.n; ++i) {
-    Type line = GenerateKey();
-    // keys.push_back(line);
-    sketch.Insert(line, 0);
+  if (load.type == "string") {
+    Run<std::string>(load);
+  } else if (load.type == "uint64") {
+    Run<uint64_t>(load);
+  } else if (load.type == "double") {
+    Run<double>(load);
+  } else {
+    fmt::print("Unknown key type {}\n", load.type);
+    return 1;
   }
-  fmt::print("Inserted {} keys\n", options.n);
-  sketch.Close();
   return 0;
 }
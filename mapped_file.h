@@ -0,0 +1,68 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read-only memory mapping of a whole file. Throws std::system_error if the
+// file cannot be opened or mapped.
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &path) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      throw std::system_error(errno, std::generic_category(), "open " + path);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      const int error = errno;
+      ::close(fd);
+      throw std::system_error(error, std::generic_category(), "stat " + path);
+    }
+    size_ = static_cast<uint64_t>(st.st_size);
+    if (size_ > 0) {
+      void *data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        const int error = errno;
+        ::close(fd);
+        throw std::system_error(error, std::generic_category(),
+                                "mmap " + path);
+      }
+      data_ = static_cast<const char *>(data);
+    }
+    ::close(fd);
+  }
+
+  ~MappedFile() {
+    if (data_ != nullptr) {
+      ::munmap(const_cast<char *>(data_), size_);
+    }
+  }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  [[nodiscard]] const char *data() const { return data_; }
+  [[nodiscard]] uint64_t size() const { return size_; }
+
+  // madvise() over [offset, offset + length), clipped to the file. offset
+  // must be page aligned. Advice is only a hint, so failures are ignored.
+  void Advise(const uint64_t offset, uint64_t length, const int advice) const {
+    if (data_ == nullptr || offset >= size_) {
+      return;
+    }
+    length = std::min(length, size_ - offset);
+    ::madvise(const_cast<char *>(data_) + offset, length, advice);
+  }
+
+private:
+  const char *data_ = nullptr;
+  uint64_t size_ = 0;
+};
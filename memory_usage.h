@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Heap bytes an item owns outside of sizeof(T). Specialize for key types
+// that allocate; kAllocates lets the sketch skip the bookkeeping entirely
+// for types that never do.
+template <typename T> struct HeapBytes {
+  static constexpr bool kAllocates = false;
+  static uint64_t Of(const T &) { return 0; }
+};
+
+// A std::string owns a heap block once it outgrows the small string buffer.
+template <> struct HeapBytes<std::string> {
+  static constexpr bool kAllocates = true;
+  static uint64_t Of(const std::string &value) {
+    static const uint64_t small_capacity = std::string().capacity();
+    return value.capacity() > small_capacity ? value.capacity() + 1 : 0;
+  }
+};
+
+struct LevelMemoryUsage {
+  // Capacity of the level's buffer and run bookkeeping.
+  uint64_t buffer_bytes = 0;
+  // Heap bytes owned by the items in the buffer.
+  uint64_t payload_bytes = 0;
+  // Packed storage, if the level is packed.
+  uint64_t packed_bytes = 0;
+
+  [[nodiscard]] uint64_t Total() const {
+    return buffer_bytes + payload_bytes + packed_bytes;
+  }
+};
+
+struct SketchMemoryUsage {
+  std::vector<LevelMemoryUsage> levels;
+  // Staging buffer capacity plus its items' heap bytes.
+  uint64_t staging_bytes = 0;
+  // Sorted view built by Close(): items, their heap bytes and cumulative
+  // weights.
+  uint64_t view_bytes = 0;
+  // The sketch object and its vector of compactors.
+  uint64_t overhead_bytes = 0;
+  uint64_t total_bytes = 0;
+};
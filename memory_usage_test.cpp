@@ -0,0 +1,70 @@
+#include "memory_usage.h"
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "relative_error_quantiles_sketch.h"
+
+// Payload bytes found by walking every item.
+template <typename T>
+uint64_t WalkedPayload(const RelativeErrorQuantilesSketch<T> &sketch,
+                       const uint64_t h) {
+  uint64_t bytes = 0;
+  for (const T &item : sketch.Compactors()[h].buffer) {
+    bytes += HeapBytes<T>::Of(item);
+  }
+  return bytes;
+}
+
+TEST(MemoryUsageTest, HeapBytes) {
+  ASSERT_EQ(HeapBytes<std::string>::Of("short"), 0);
+  const std::string long_key(100, 'x');
+  ASSERT_GE(HeapBytes<std::string>::Of(long_key), 101);
+  ASSERT_EQ(HeapBytes<uint64_t>::Of(7), 0);
+}
+
+TEST(MemoryUsageTest, StringPayloadsTrackedIncrementally) {
+  RelativeErrorQuantilesSketchOptions options = {
+      .n = 1 << 16, .k = 16, .staging_size = 16};
+  RelativeErrorQuantilesSketch<std::string> sketch(options);
+  RelativeErrorQuantilesSketch<std::string> other(options);
+  for (int i = 0; i < 20000; ++i) {
+    // Half short keys, half heap-allocated ones.
+    const std::string key = i % 2 == 0 ? fmt::format("{}", i)
+                                        : fmt::format("{:040}", i);
+    sketch.Insert(key, 0);
+    other.Insert(key, 0);
+  }
+  sketch.Merge(other);
+
+  const SketchMemoryUsage usage = sketch.MemoryUsage();
+  ASSERT_EQ(usage.levels.size(), sketch.Depth() + 1);
+  uint64_t total = usage.overhead_bytes + usage.staging_bytes;
+  for (uint64_t h = 0; h < usage.levels.size(); ++h) {
+    ASSERT_EQ(usage.levels[h].payload_bytes, WalkedPayload(sketch, h));
+    ASSERT_EQ(usage.levels[h].buffer_bytes % sizeof(std::string), 0);
+    total += usage.levels[h].Total();
+  }
+  ASSERT_GT(usage.levels[0].payload_bytes, 0);
+  ASSERT_EQ(usage.view_bytes, 0);
+  ASSERT_EQ(usage.total_bytes, total);
+
+  sketch.Close();
+  ASSERT_GT(sketch.MemoryUsage().view_bytes,
+            sketch.Items().size() * sizeof(std::string));
+}
+
+TEST(MemoryUsageTest, PackedLevels) {
+  RelativeErrorQuantilesSketchOptions options = {.n = 1 << 16, .k = 16};
+  RelativeErrorQuantilesSketch<uint64_t> sketch(options);
+  for (uint64_t i = 0; i < (1 << 16); ++i) {
+    sketch.Insert(i, 0);
+  }
+  const uint64_t before = sketch.MemoryUsage().total_bytes;
+  sketch.Pack();
+  const SketchMemoryUsage usage = sketch.MemoryUsage();
+  ASSERT_LT(usage.total_bytes, before);
+  ASSERT_EQ(usage.levels[0].packed_bytes, 0);
+  ASSERT_GT(usage.levels[1].packed_bytes, 0);
+  ASSERT_EQ(usage.levels[1].payload_bytes, 0);
+}
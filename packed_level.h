@@ -0,0 +1,208 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Number of values per packed block.
+constexpr uint64_t kPackedBlockSize = 128;
+
+// Compressed copy of a sorted run of integers. Values are split into blocks
+// of 128; each block stores its first value (frame of reference) and the
+// gaps between consecutive values bit-packed at the block's widest gap.
+// Gaps are laid out in four interleaved lanes, value i of a block going to
+// lane i % 4, so the four lanes of each word row decode together with one
+// AVX2 shift and mask. Decoding is a prefix sum over the gaps.
+//
+// Only integral T can be packed; other types may name the class but not
+// construct a non-empty one.
+template <typename T> class PackedSortedLevel {
+public:
+  PackedSortedLevel() = default;
+
+  // Packs sorted, which must be in ascending order.
+  explicit PackedSortedLevel(const std::vector<T> &sorted)
+      : size_(sorted.size()) {
+    static_assert(std::is_integral_v<T>, "only integers can be packed");
+    assert(std::is_sorted(sorted.begin(), sorted.end()));
+    uint64_t gaps[kPackedBlockSize];
+    for (uint64_t first = 0; first < size_; first += kPackedBlockSize) {
+      const uint64_t count = std::min(kPackedBlockSize, size_ - first);
+      Block block;
+      block.base = ToOrdered(sorted[first]);
+      block.offset = words_.size();
+      uint64_t widest = 0;
+      uint64_t previous = block.base;
+      for (uint64_t i = 0; i < kPackedBlockSize; ++i) {
+        const uint64_t value =
+            i < count ? ToOrdered(sorted[first + i]) : previous;
+        gaps[i] = value - previous;
+        widest |= gaps[i];
+        previous = value;
+      }
+      block.width = widest == 0 ? 0 : 64 - __builtin_clzll(widest);
+      blocks_.push_back(block);
+      words_.resize(words_.size() + 4 * LaneWords(block.width), 0);
+      uint64_t *words = words_.data() + block.offset;
+      for (uint64_t row = 0; block.width > 0 && row < kPackedBlockSize / 4;
+           ++row) {
+        const uint64_t bit = row * block.width;
+        const uint64_t word = bit / 64;
+        const uint64_t shift = bit % 64;
+        for (uint64_t lane = 0; lane < 4; ++lane) {
+          const uint64_t gap = gaps[4 * row + lane];
+          words[4 * word + lane] |= gap << shift;
+          if (shift + block.width > 64) {
+            words[4 * (word + 1) + lane] |= gap >> (64 - shift);
+          }
+        }
+      }
+    }
+    words_.shrink_to_fit();
+    blocks_.shrink_to_fit();
+  }
+
+  [[nodiscard]] uint64_t size() const { return size_; }
+  [[nodiscard]] bool empty() const { return size_ == 0; }
+
+  // Heap bytes held by the packed representation.
+  [[nodiscard]] uint64_t PackedBytes() const {
+    return words_.capacity() * sizeof(uint64_t) +
+           blocks_.capacity() * sizeof(Block);
+  }
+
+  // Decodes every value, in order, into out (replacing its contents).
+  void Unpack(std::vector<T> &out) const {
+    out.resize(size_);
+    if constexpr (std::is_integral_v<T>) {
+      uint64_t values[kPackedBlockSize];
+      for (uint64_t b = 0; b < blocks_.size(); ++b) {
+        DecodeBlock(b, values);
+        const uint64_t first = b * kPackedBlockSize;
+        const uint64_t count = std::min(kPackedBlockSize, size_ - first);
+        for (uint64_t i = 0; i < count; ++i) {
+          out[first + i] = FromOrdered(values[i]);
+        }
+      }
+    }
+  }
+
+  // Number of values less than value, as std::lower_bound on the unpacked
+  // run. Finds the block by its base and decodes only that block.
+  [[nodiscard]] uint64_t LowerBound(const T value) const {
+    uint64_t index = 0;
+    if constexpr (std::is_integral_v<T>) {
+      const uint64_t ordered = ToOrdered(value);
+      // Blocks from b on start at or above value.
+      const uint64_t b =
+          std::partition_point(blocks_.begin(), blocks_.end(),
+                               [ordered](const Block &block) {
+                                 return block.base < ordered;
+                               }) -
+          blocks_.begin();
+      if (b == 0) {
+        return 0;
+      }
+      uint64_t values[kPackedBlockSize];
+      DecodeBlock(b - 1, values);
+      const uint64_t first = (b - 1) * kPackedBlockSize;
+      const uint64_t count = std::min(kPackedBlockSize, size_ - first);
+      index = first + (std::lower_bound(values, values + count, ordered) -
+                       values);
+    }
+    return index;
+  }
+
+private:
+  struct Block {
+    uint64_t base;   // First value of the block, order-mapped
+    uint32_t offset; // Index of the block's first word in words_
+    uint32_t width;  // Bits per gap, 0 to 64
+  };
+
+  // Words per lane for 32 gaps of width bits.
+  static uint64_t LaneWords(const uint64_t width) {
+    return (32 * width + 63) / 64;
+  }
+
+  // Maps T to uint64_t so that unsigned comparison preserves T's order.
+  static uint64_t ToOrdered(const T value) {
+    if constexpr (std::is_signed_v<T>) {
+      return static_cast<uint64_t>(static_cast<int64_t>(value)) ^
+             (uint64_t{1} << 63);
+    } else {
+      return static_cast<uint64_t>(value);
+    }
+  }
+
+  static T FromOrdered(const uint64_t value) {
+    if constexpr (std::is_signed_v<T>) {
+      return static_cast<T>(
+          static_cast<int64_t>(value ^ (uint64_t{1} << 63)));
+    } else {
+      return static_cast<T>(value);
+    }
+  }
+
+  // Decodes block b into 128 order-mapped values.
+  void DecodeBlock(const uint64_t b, uint64_t *values) const {
+    const Block &block = blocks_[b];
+    const uint64_t *words = words_.data() + block.offset;
+    const uint64_t width = block.width;
+    if (width == 0) {
+      std::fill(values, values + kPackedBlockSize, block.base);
+      return;
+    }
+    const uint64_t mask =
+        width == 64 ? ~uint64_t{0} : (uint64_t{1} << width) - 1;
+    uint64_t row = 0;
+#if defined(__AVX2__)
+    const __m256i lane_mask = _mm256_set1_epi64x(static_cast<int64_t>(mask));
+    for (; row < kPackedBlockSize / 4; ++row) {
+      const uint64_t bit = row * width;
+      const uint64_t word = bit / 64;
+      const uint64_t shift = bit % 64;
+      __m256i gaps = _mm256_srl_epi64(
+          _mm256_loadu_si256(
+              reinterpret_cast<const __m256i *>(words + 4 * word)),
+          _mm_cvtsi64_si128(static_cast<int64_t>(shift)));
+      if (shift + width > 64) {
+        gaps = _mm256_or_si256(
+            gaps, _mm256_sll_epi64(
+                      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(
+                          words + 4 * (word + 1))),
+                      _mm_cvtsi64_si128(static_cast<int64_t>(64 - shift))));
+      }
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(values + 4 * row),
+                          _mm256_and_si256(gaps, lane_mask));
+    }
+#endif
+    for (; row < kPackedBlockSize / 4; ++row) {
+      const uint64_t bit = row * width;
+      const uint64_t word = bit / 64;
+      const uint64_t shift = bit % 64;
+      for (uint64_t lane = 0; lane < 4; ++lane) {
+        uint64_t gap = words[4 * word + lane] >> shift;
+        if (shift + width > 64) {
+          gap |= words[4 * (word + 1) + lane] << (64 - shift);
+        }
+        values[4 * row + lane] = gap & mask;
+      }
+    }
+    uint64_t value = block.base;
+    for (uint64_t i = 0; i < kPackedBlockSize; ++i) {
+      value += values[i];
+      values[i] = value;
+    }
+  }
+
+  uint64_t size_ = 0;
+  std::vector<uint64_t> words_;
+  std::vector<Block> blocks_;
+};
@@ -0,0 +1,73 @@
+#include "packed_level.h"
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+
+template <typename T> void ExpectRoundTrip(const std::vector<T> &sorted) {
+  const PackedSortedLevel<T> packed(sorted);
+  ASSERT_EQ(packed.size(), sorted.size());
+  std::vector<T> unpacked = {1, 2, 3};
+  packed.Unpack(unpacked);
+  ASSERT_EQ(unpacked, sorted);
+}
+
+TEST(PackedLevelTest, RoundTripsEveryWidth) {
+  std::mt19937_64 gen(3);
+  for (int width = 0; width <= 64; ++width) {
+    // 300 values: two full blocks and a partial one.
+    std::vector<uint64_t> values(300);
+    for (auto &value : values) {
+      value = width == 0 ? 7 : gen() >> (64 - width);
+    }
+    std::sort(values.begin(), values.end());
+    ExpectRoundTrip(values);
+  }
+  ExpectRoundTrip(std::vector<uint64_t>());
+  ExpectRoundTrip(
+      std::vector<uint64_t>{0, std::numeric_limits<uint64_t>::max()});
+}
+
+TEST(PackedLevelTest, SignedValues) {
+  std::vector<int64_t> values = {std::numeric_limits<int64_t>::min(), -5, -5,
+                                 0, 3, std::numeric_limits<int64_t>::max()};
+  ExpectRoundTrip(values);
+  std::vector<int32_t> small;
+  for (int32_t i = -1000; i < 1000; i += 3) {
+    small.push_back(i);
+  }
+  ExpectRoundTrip(small);
+}
+
+TEST(PackedLevelTest, SmallGapsPackTightly) {
+  // Timestamps in nanoseconds, roughly a millisecond apart.
+  std::mt19937_64 gen(5);
+  std::vector<uint64_t> timestamps(10000);
+  uint64_t now = 1'700'000'000'000'000'000;
+  for (auto &timestamp : timestamps) {
+    now += 1'000'000 + gen() % 100'000;
+    timestamp = now;
+  }
+  const PackedSortedLevel<uint64_t> packed(timestamps);
+  ASSERT_LT(packed.PackedBytes() * 2, timestamps.size() * sizeof(uint64_t));
+  ExpectRoundTrip(timestamps);
+}
+
+TEST(PackedLevelTest, LowerBound) {
+  // Runs of duplicates that straddle block boundaries.
+  std::vector<int64_t> values;
+  for (int64_t i = -200; i < 200; ++i) {
+    values.insert(values.end(), 1 + (i & 3), i * 10);
+  }
+  const PackedSortedLevel<int64_t> packed(values);
+  for (int64_t probe = -2100; probe <= 2100; ++probe) {
+    ASSERT_EQ(packed.LowerBound(probe),
+              std::lower_bound(values.begin(), values.end(), probe) -
+                  values.begin())
+        << probe;
+  }
+  ASSERT_EQ(PackedSortedLevel<int64_t>().LowerBound(0), 0);
+}
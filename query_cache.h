@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Small least-recently-used cache of query results for one sketch. Results
+// are only valid for the sketch version they were computed at, so looking
+// up a newer version drops every entry. Lookups scan the entries linearly,
+// which beats hashing at the handful of entries a dashboard polls.
+template <typename Key, typename Value> class QueryCache {
+public:
+  explicit QueryCache(const uint64_t capacity) : capacity_(capacity) {
+    entries_.reserve(capacity_);
+  }
+
+  [[nodiscard]] uint64_t Capacity() const { return capacity_; }
+  [[nodiscard]] uint64_t Size() const { return entries_.size(); }
+
+  // The value cached for key at version, or nullptr.
+  [[nodiscard]] const Value *Find(const Key &key, const uint64_t version) {
+    Expire(version);
+    for (auto &entry : entries_) {
+      if (entry.key == key) {
+        entry.last_used = ++clock_;
+        return &entry.value;
+      }
+    }
+    return nullptr;
+  }
+
+  // Caches value for key at version, evicting the least recently used entry
+  // when full. Returns the cached copy.
+  const Value &Put(Key key, const uint64_t version, Value value) {
+    assert(capacity_ > 0);
+    Expire(version);
+    if (entries_.size() == capacity_) {
+      auto oldest = std::min_element(
+          entries_.begin(), entries_.end(),
+          [](const Entry &a, const Entry &b) {
+            return a.last_used < b.last_used;
+          });
+      entries_.erase(oldest);
+    }
+    entries_.push_back(Entry{.key = std::move(key),
+                             .value = std::move(value),
+                             .last_used = ++clock_});
+    return entries_.back().value;
+  }
+
+  void Clear() { entries_.clear(); }
+
+private:
+  struct Entry {
+    Key key;
+    Value value;
+    uint64_t last_used;
+  };
+
+  void Expire(const uint64_t version) {
+    if (version != version_) {
+      entries_.clear();
+      version_ = version;
+    }
+  }
+
+  uint64_t capacity_;
+  uint64_t version_ = 0;
+  uint64_t clock_ = 0;
+  std::vector<Entry> entries_;
+};
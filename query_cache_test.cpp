@@ -0,0 +1,29 @@
+#include "query_cache.h"
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+TEST(QueryCacheTest, HitsUntilVersionChanges) {
+  QueryCache<int, std::string> cache(4);
+  ASSERT_EQ(cache.Find(10, 1), nullptr);
+  ASSERT_EQ(cache.Put(10, 1, "ten"), "ten");
+  ASSERT_NE(cache.Find(10, 1), nullptr);
+  ASSERT_EQ(*cache.Find(10, 1), "ten");
+  // A newer version drops everything cached before it.
+  ASSERT_EQ(cache.Find(10, 2), nullptr);
+  ASSERT_EQ(cache.Size(), 0);
+}
+
+TEST(QueryCacheTest, EvictsLeastRecentlyUsed) {
+  QueryCache<std::vector<double>, int> cache(2);
+  cache.Put({0.5}, 1, 1);
+  cache.Put({0.5, 0.9}, 1, 2);
+  // Touch the first entry so the second is the oldest.
+  ASSERT_NE(cache.Find({0.5}, 1), nullptr);
+  cache.Put({0.99}, 1, 3);
+  ASSERT_EQ(cache.Size(), 2);
+  ASSERT_EQ(*cache.Find({0.5}, 1), 1);
+  ASSERT_EQ(cache.Find({0.5, 0.9}, 1), nullptr);
+  ASSERT_EQ(*cache.Find({0.99}, 1), 3);
+}
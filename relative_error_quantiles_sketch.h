@@ -7,13 +7,48 @@
 #include <fmt/core.h>
 #include <functional>
 #include <map>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
 #include <vector>
 
 #include "compactor.h"
+#include "kernels.h"
+#include "memory_usage.h"
+#include "query_cache.h"
+#include "sorting_network.h"
+#include "thread_pool.h"
+
+// How buffer sizes are chosen for each level of the compaction hierarchy.
+enum class BufferSizing {
+  // Every level is sized for the full stream length n.
+  kUniform,
+  // Level h is sized for the n / 2^h items that can reach it, so upper levels
+  // get fewer sections. Each compactor still has enough sections for the
+  // stream it actually sees, which is what the error guarantee relies on.
+  kLevelScaled,
+};
 
 struct RelativeErrorQuantilesSketchOptions {
   uint64_t n;
   uint64_t k;
+  BufferSizing sizing = BufferSizing::kUniform;
+  // Multiplier on the section size of level 0. Level 0 sees every item, so a
+  // larger buffer there amortises compaction over more inserts. Larger
+  // sections only ever reduce error.
+  uint64_t level0_k_multiplier = 1;
+  // Size of the staging buffer in front of level 0, or 0 to insert straight
+  // into level 0. Staged items are sorted as a mini-batch while still in
+  // cache and appended to level 0 as a sorted run, so level-0 compaction
+  // merges runs instead of sorting a cold buffer. Keep it small (e.g. 64) so
+  // it stays in L1; power of two sizes use a sorting network for numeric T.
+  uint64_t staging_size = 0;
+  // Number of recent results kept for each kind of query (Quantiles(),
+  // GetLiveQuantile(), EstimateLiveRank(), LiveCdf()), or 0 to cache
+  // nothing. Cached results are returned until the sketch next changes; see
+  // Version().
+  uint64_t query_cache_size = 0;
 };
 
 template <typename T> class RelativeErrorQuantilesSketch {
@@ -21,24 +56,145 @@ public:
   explicit RelativeErrorQuantilesSketch(
       const RelativeErrorQuantilesSketchOptions &options)
       : options_(options), H_(0), compactors_(std::vector<Compactor<T>>()),
-        total_weight_(0) {
+        total_weight_(0), quantiles_cache_(options.query_cache_size),
+        live_quantile_cache_(options.query_cache_size),
+        live_rank_cache_(options.query_cache_size),
+        live_cdf_cache_(options.query_cache_size) {
     fmt::print("Creating Relative error quantiles sketch with parameters k {} "
                "n {}...\n",
                options.k, options.n);
-    compactors_.push_back(Compactor<T>(options_.k, options_.n, 0));
+    compactors_.push_back(MakeCompactor(0));
+    staging_.reserve(options_.staging_size);
   }
 
   void Insert(const T &element, const uint64_t h) {
-    if (H_ < h) {
-      fmt::print("Sketch H {} < intended h {}, creating new compactor\n", H_,
-                 h);
-      H_ = h;
-      compactors_.push_back(Compactor<T>(options_.k, options_.n, h));
+    ++version_;
+    if (h == 0 && options_.staging_size > 0) {
+      staging_.push_back(element);
+      if constexpr (HeapBytes<T>::kAllocates) {
+        staging_payload_bytes_ += HeapBytes<T>::Of(staging_.back());
+      }
+      if (staging_.size() == options_.staging_size) {
+        FlushStaging();
+      }
+      return;
     }
 
+    EnsureLevel(h);
+
     std::vector<T> output_stream = std::move(compactors_[h].Insert(element));
-    std::for_each(output_stream.begin(), output_stream.end(),
-                  [this, h](const T &t) -> void { Insert(t, h + 1); });
+    if (!output_stream.empty()) {
+      Promote(output_stream, h + 1);
+    }
+  }
+
+  // Inserts the items [first, last) at level 0. The iterators may yield
+  // anything T can be constructed from (e.g. std::string_view for string
+  // keys), so items are built in place in the staging buffer or level-0
+  // buffer without an intermediate copy. Requires random access iterators.
+  template <typename Iterator> void InsertBatch(Iterator first, Iterator last) {
+    ++version_;
+    if (options_.staging_size > 0) {
+      for (; first != last; ++first) {
+        staging_.emplace_back(*first);
+        if constexpr (HeapBytes<T>::kAllocates) {
+          staging_payload_bytes_ += HeapBytes<T>::Of(staging_.back());
+        }
+        if (staging_.size() == options_.staging_size) {
+          FlushStaging();
+        }
+      }
+      return;
+    }
+
+    std::vector<T> output_stream;
+    compactors_[0].InsertBatch(first, last, output_stream);
+    if (!output_stream.empty()) {
+      Promote(output_stream, 1);
+    }
+  }
+
+  // Merges other into this sketch, level by level: other's level-h items
+  // keep their weight by being appended to level h here, compacting into the
+  // levels above as needed. Compaction schedules are combined with a bitwise
+  // or. Both sketches should have been created with the same options; other
+  // is left untouched.
+  void Merge(const RelativeErrorQuantilesSketch &other) {
+    assert(&other != this);
+    ++version_;
+    for (uint64_t h = 0; h < other.compactors_.size(); ++h) {
+      EnsureLevel(h);
+      const Compactor<T> &source = other.compactors_[h];
+      compactors_[h].C |= source.C;
+      std::vector<T> scratch;
+      const std::vector<T> &items = source.Items(scratch);
+      std::vector<T> output_stream;
+      // Levels above 0 are usually still made of sorted runs; appending them
+      // as runs keeps this level mergeable when it next compacts.
+      if (source.sorted_runs || source.is_packed) {
+        compactors_[h].InsertRuns(items.data(), items.data() + items.size(),
+                                  output_stream);
+      } else {
+        compactors_[h].InsertBatch(items.begin(), items.end(), output_stream);
+      }
+      if (!output_stream.empty()) {
+        Promote(output_stream, h + 1);
+      }
+    }
+    InsertBatch(other.staging_.begin(), other.staging_.end());
+  }
+
+  // Merge() with levels processed in parallel on pool. Levels only interact
+  // through the items one promotes into the next, so the merge runs in
+  // waves: first every level appends other's items for it, all at once;
+  // then every level that received promotions in the previous wave appends
+  // them, and so on until nothing is promoted. Compactions then happen at
+  // other points than in Merge(), so from level 2 up the retained items
+  // differ, but each level still promotes half of what it compacts with
+  // weight doubled: the total weight and the per-level error guarantee are
+  // the same as Merge()'s.
+  void Merge(const RelativeErrorQuantilesSketch &other, ThreadPool &pool) {
+    assert(&other != this);
+    ++version_;
+    EnsureLevel(other.compactors_.size() - 1);
+    // promoted[h] holds what level h promoted in the last wave.
+    std::vector<std::vector<T>> promoted(compactors_.size());
+    pool.ParallelFor(other.compactors_.size(), [&](const uint64_t h) {
+      const Compactor<T> &source = other.compactors_[h];
+      compactors_[h].C |= source.C;
+      std::vector<T> scratch;
+      const std::vector<T> &items = source.Items(scratch);
+      // As in Merge(), sorted levels are appended as runs.
+      if (source.sorted_runs || source.is_packed) {
+        compactors_[h].InsertRuns(items.data(), items.data() + items.size(),
+                                  promoted[h]);
+      } else {
+        compactors_[h].InsertBatch(items.begin(), items.end(), promoted[h]);
+      }
+    });
+
+    std::vector<uint64_t> sources;
+    while (true) {
+      sources.clear();
+      for (uint64_t h = 0; h < promoted.size(); ++h) {
+        if (!promoted[h].empty()) {
+          sources.push_back(h);
+        }
+      }
+      if (sources.empty()) {
+        break;
+      }
+      EnsureLevel(sources.back() + 1);
+      std::vector<std::vector<T>> next(compactors_.size());
+      pool.ParallelFor(sources.size(), [&](const uint64_t i) {
+        const uint64_t h = sources[i];
+        compactors_[h + 1].InsertRuns(promoted[h].data(),
+                                      promoted[h].data() + promoted[h].size(),
+                                      next[h + 1]);
+      });
+      promoted = std::move(next);
+    }
+    InsertBatch(other.staging_.begin(), other.staging_.end());
   }
 
   struct WeightedElement {
@@ -47,56 +203,188 @@ public:
   };
 
   void Close() {
+    ++version_;
+    FlushStaging();
     assert(H_ + 1 == compactors_.size());
 
     // Weight of an item is 2^h, where h is the position the compactor has in
     // the overall hierarchy.
+    std::vector<WeightedElement> weighted_elements;
     uint64_t h = 0;
+    std::vector<T> scratch;
     for (auto &compactor : compactors_) {
       const double weight = std::pow(2, h);
       compactor.buffer.shrink_to_fit();
-      std::transform(compactor.buffer.begin(), compactor.buffer.end(),
-                     std::back_inserter(weighted_elements_),
+      // Packed levels are decoded into scratch and stay packed.
+      const std::vector<T> &items = compactor.Items(scratch);
+      std::transform(items.begin(), items.end(),
+                     std::back_inserter(weighted_elements),
                      [weight](const T &t) -> WeightedElement {
-                       assert(!t.empty());
+                       if constexpr (std::is_same_v<T, std::string>) {
+                         assert(!t.empty());
+                       }
                        return WeightedElement{.item = t, .weight = weight};
                      });
       ++h;
     };
-    std::sort(weighted_elements_.begin(), weighted_elements_.end(),
+    std::sort(weighted_elements.begin(), weighted_elements.end(),
               [](const WeightedElement &w1, const WeightedElement &w2) -> bool {
                 return w1.item < w2.item;
               });
+
+    // The view is kept as separate key and cumulative weight arrays so rank
+    // and quantile lookups each search one dense array.
+    items_.clear();
+    items_.reserve(weighted_elements.size());
+    cumulative_weights_.clear();
+    cumulative_weights_.reserve(weighted_elements.size());
+    for (auto &element : weighted_elements) {
+      items_.push_back(std::move(element.item));
+      cumulative_weights_.push_back(element.weight);
+    }
+    PrefixSum(cumulative_weights_.data(), cumulative_weights_.size());
+    view_bytes_ = items_.capacity() * sizeof(T) +
+                  cumulative_weights_.capacity() * sizeof(double);
+    if constexpr (HeapBytes<T>::kAllocates) {
+      for (const T &item : items_) {
+        view_bytes_ += HeapBytes<T>::Of(item);
+      }
+    }
     total_weight_ =
-        std::accumulate(weighted_elements_.begin(), weighted_elements_.end(),
-                        static_cast<double>(0.0),
-                        [](double d, const WeightedElement &element) -> double {
-                          return d + element.weight;
-                        });
-    /*for (const auto &element : weighted_elements_) {
-      fmt::print("WeightedElement[ .item = {}, .weight = {}]\n", element.item,
-                 element.weight);
-    }*/
+        cumulative_weights_.empty() ? 0.0 : cumulative_weights_.back();
   }
 
   [[nodiscard]] double EstimateRank(const T &item) const {
-    auto it = std::lower_bound(
-        weighted_elements_.begin(), weighted_elements_.end(), item,
-        [](const WeightedElement &element, const T &t) -> bool {
-          return element.item < t;
-        });
-    auto index = std::distance(weighted_elements_.begin(), it);
+    uint64_t index = 0;
+    if constexpr (UseInterpolationSearch<T>::value) {
+      index = InterpolationLowerBound(items_.data(), items_.size(), item);
+    } else {
+      index = std::lower_bound(items_.begin(), items_.end(), item) -
+              items_.begin();
+    }
     fmt::print("Found {} elements smaller than item {} out of {}\n", index,
-               item, weighted_elements_.size());
-    double item_weight = std::accumulate(
-        weighted_elements_.begin(), it, static_cast<double>(0.0),
-        [](double d, const WeightedElement &element) -> double {
-          return d + element.weight;
-        });
+               item, items_.size());
+    double item_weight = index == 0 ? 0.0 : cumulative_weights_[index - 1];
     fmt::print("Item weight {} total weight {}\n", item_weight, total_weight_);
     return item_weight;
   }
 
+  // Returns the smallest item whose cumulative weight reaches rank (in
+  // [0, 1]) of the total weight.
+  [[nodiscard]] T GetQuantile(double rank) const {
+    assert(!items_.empty());
+    return items_[QuantileIndex(rank)];
+  }
+
+  // GetQuantile() without the copy: a reference into the view, valid until
+  // the next Close(). For string keys this avoids a heap allocation per
+  // query.
+  [[nodiscard]] const T &QuantileItem(double rank) const {
+    assert(!items_.empty());
+    return items_[QuantileIndex(rank)];
+  }
+
+  // GetQuantile() on a sketch that has not been closed, or has taken inserts
+  // since: selects the item straight from the level buffers and the staging
+  // buffer, with each item weighted 2^h by its level, without building the
+  // sorted view. The sorted runs a level tracks are searched as they are,
+  // so run tracking survives the query; packed levels are decoded into
+  // scratch and stay packed. Only levels that have lost their runs (single
+  // Insert() calls) are sorted in place, as for EstimateLiveRank(), and the
+  // staged items are sorted, which their next flush does anyway. Throws
+  // std::out_of_range if nothing has been inserted.
+  [[nodiscard]] T GetLiveQuantile(double rank) {
+    if (options_.query_cache_size > 0) {
+      if (const T *cached = live_quantile_cache_.Find(rank, version_)) {
+        return *cached;
+      }
+    }
+    SortBatch(staging_.data(), staging_.size());
+    std::vector<LiveRange> ranges;
+    double total_weight = static_cast<double>(staging_.size());
+    ranges.push_back(LiveRange{.first = staging_.data(),
+                               .last = staging_.data() + staging_.size(),
+                               .weight = 1.0});
+    std::vector<std::vector<T>> decoded(compactors_.size());
+    for (auto &compactor : compactors_) {
+      const double weight = std::pow(2, compactor.h);
+      total_weight += weight * compactor.Size();
+      if (compactor.is_packed) {
+        const std::vector<T> &items = compactor.Items(decoded[compactor.h]);
+        ranges.push_back(LiveRange{.first = items.data(),
+                                   .last = items.data() + items.size(),
+                                   .weight = weight});
+        continue;
+      }
+      if (!compactor.sorted_runs) {
+        compactor.Sort();
+      }
+      const T *data = compactor.buffer.data();
+      uint64_t begin = 0;
+      for (const uint64_t end : compactor.run_ends) {
+        ranges.push_back(LiveRange{
+            .first = data + begin, .last = data + end, .weight = weight});
+        begin = end;
+      }
+      assert(begin == compactor.buffer.size());
+    }
+    if (total_weight == 0) {
+      throw std::out_of_range("quantile of an empty sketch");
+    }
+    T quantile = WeightedSelect(ranges, rank * total_weight);
+    if (options_.query_cache_size > 0) {
+      live_quantile_cache_.Put(rank, version_, quantile);
+    }
+    return quantile;
+  }
+
+  // EstimateRank() without Close(): the weight of the items less than item,
+  // summed over levels as 2^h times one binary search per level, plus a
+  // scan of the few staged items. Nothing is copied and no view is built.
+  // Levels are sorted in place first where they are not already (see
+  // Compactor::Sort()); a sorted level stays sorted until it is next
+  // written, so repeated queries cost O(levels * log(buffer size)).
+  [[nodiscard]] double EstimateLiveRank(const T &item) {
+    if (options_.query_cache_size > 0) {
+      if (const double *cached = live_rank_cache_.Find(item, version_)) {
+        return *cached;
+      }
+    }
+    SortLevels();
+    const double rank = LiveRank(item);
+    if (options_.query_cache_size > 0) {
+      live_rank_cache_.Put(item, version_, rank);
+    }
+    return rank;
+  }
+
+  // Normalized live rank of each of splits, which must be ascending,
+  // followed by 1.0: entry i is the fraction of the weight below splits[i],
+  // and the last entry covers everything.
+  [[nodiscard]] std::vector<double> LiveCdf(const std::vector<T> &splits) {
+    assert(std::is_sorted(splits.begin(), splits.end()));
+    if (options_.query_cache_size > 0) {
+      if (const auto *cached = live_cdf_cache_.Find(splits, version_)) {
+        return *cached;
+      }
+    }
+    SortLevels();
+    double total_weight = static_cast<double>(staging_.size());
+    for (const auto &compactor : compactors_) {
+      total_weight += std::pow(2, compactor.h) * compactor.Size();
+    }
+    std::vector<double> cdf;
+    cdf.reserve(splits.size() + 1);
+    for (const T &split : splits) {
+      cdf.push_back(total_weight > 0 ? LiveRank(split) / total_weight : 0.0);
+    }
+    cdf.push_back(1.0);
+    if (options_.query_cache_size > 0) {
+      live_cdf_cache_.Put(splits, version_, cdf);
+    }
+    return cdf;
+  }
+
   struct Quantile {
     int quantile;
     T item;
@@ -104,35 +392,184 @@ public:
   };
 
   [[nodiscard]] std::vector<Quantile> Quantiles(int n) {
+    if (options_.query_cache_size > 0) {
+      if (const auto *cached = quantiles_cache_.Find(n, version_)) {
+        return *cached;
+      }
+    }
     std::vector<Quantile> quantiles;
+    if (items_.empty()) {
+      return quantiles;
+    }
 
-    int current_quantile = 1;
-    double current_total_weight = 0.0;
-    int index = 0;
-    for (const auto &element : weighted_elements_) {
-      current_total_weight += element.weight;
-      if (current_total_weight / total_weight_ >=
-          static_cast<double>(current_quantile) / n) {
-        Quantile quantile = {.quantile = current_quantile,
-                             .item = element.item,
-                             .cumulative_weight = current_total_weight};
-        quantiles.push_back(quantile);
-        fmt::print(
-            "Found {} out of {} quantiles at item {} [index {} current total "
-            "weight {}, total weight {}]\n",
-            current_quantile, n, element.item, index, current_total_weight,
-            total_weight_);
-        ++current_quantile;
-      }
-      ++index;
+    for (int current_quantile = 1; current_quantile <= n; ++current_quantile) {
+      const uint64_t index =
+          QuantileIndex(static_cast<double>(current_quantile) / n);
+      Quantile quantile = {.quantile = current_quantile,
+                           .item = items_[index],
+                           .cumulative_weight = cumulative_weights_[index]};
+      quantiles.push_back(quantile);
+      fmt::print(
+          "Found {} out of {} quantiles at item {} [index {} current total "
+          "weight {}, total weight {}]\n",
+          current_quantile, n, items_[index], index,
+          cumulative_weights_[index], total_weight_);
+    }
+    if (options_.query_cache_size > 0) {
+      quantiles_cache_.Put(n, version_, quantiles);
     }
     return quantiles;
   }
 
+  // The closed view reduced to at most m points for export, e.g. to draw a
+  // CDF. One pass over the view cuts it into buckets at every multiple of
+  // W / m of cumulative weight (W the total weight); each bucket becomes
+  // its largest item carrying the bucket's weight. Cumulative weights at
+  // the returned points are exact, and any rank computed from the points
+  // is off by less than W / m plus the largest single item weight in the
+  // view. Returns the whole view when it has at most m items.
+  [[nodiscard]] std::vector<WeightedElement>
+  Downsample(const uint64_t m) const {
+    assert(m > 0);
+    std::vector<WeightedElement> points;
+    if (items_.empty()) {
+      return points;
+    }
+    points.reserve(std::min<uint64_t>(m, items_.size()));
+    // Bucket j ends at the first item reaching j * W / m. The last bucket
+    // ends at W itself, so there are at most m.
+    const bool keep_all = items_.size() <= m;
+    double boundary = keep_all ? 0.0 : total_weight_ / m;
+    double emitted = 0.0;
+    for (uint64_t i = 0; i < items_.size(); ++i) {
+      const double cumulative = cumulative_weights_[i];
+      if (cumulative >= boundary || i + 1 == items_.size()) {
+        points.push_back(WeightedElement{.item = items_[i],
+                                         .weight = cumulative - emitted});
+        emitted = cumulative;
+        if (!keep_all) {
+          const double bucket = std::floor(cumulative * m / total_weight_);
+          boundary = total_weight_ * std::min<double>(bucket + 1, m) / m;
+        }
+      }
+    }
+    assert(points.size() <= m);
+    return points;
+  }
+
+  // A quantile of the view by position: index into Items() and
+  // CumulativeWeights(), and a pointer to the item. Valid until the next
+  // Close().
+  struct QuantileRef {
+    int quantile;
+    uint64_t index;
+    const T *item;
+    double cumulative_weight;
+  };
+
+  // Quantiles(n) without copying items: out is overwritten with one entry
+  // per quantile, reusing its capacity, so polling with the same vector
+  // allocates nothing.
+  void QuantileRefs(int n, std::vector<QuantileRef> &out) const {
+    out.clear();
+    if (items_.empty()) {
+      return;
+    }
+    for (int current_quantile = 1; current_quantile <= n; ++current_quantile) {
+      const uint64_t index =
+          QuantileIndex(static_cast<double>(current_quantile) / n);
+      out.push_back(
+          QuantileRef{.quantile = current_quantile,
+                      .index = index,
+                      .item = &items_[index],
+                      .cumulative_weight = cumulative_weights_[index]});
+    }
+  }
+
+  // The sorted view built by Close(): items in ascending order and the
+  // inclusive cumulative weight at each of them.
+  [[nodiscard]] const std::vector<T> &Items() const { return items_; }
+  [[nodiscard]] const std::vector<double> &CumulativeWeights() const {
+    return cumulative_weights_;
+  }
+
+  [[nodiscard]] const RelativeErrorQuantilesSketchOptions &Options() const {
+    return options_;
+  }
+
   [[nodiscard]] uint64_t Depth() const { return H_; }
 
+  // Changes whenever the items the sketch holds may have changed: on every
+  // insert (and the compactions it triggers), merge and Close().
+  [[nodiscard]] uint64_t Version() const { return version_; }
+
+  [[nodiscard]] const std::vector<Compactor<T>> &Compactors() const {
+    return compactors_;
+  }
+
   [[nodiscard]] double TotalWeight() const { return total_weight_; }
 
+  // Number of items currently held across all compactors.
+  [[nodiscard]] uint64_t RetainedItems() const {
+    return std::accumulate(compactors_.begin(), compactors_.end(),
+                           static_cast<uint64_t>(staging_.size()),
+                           [](uint64_t sum, const Compactor<T> &compactor) {
+                             return sum + compactor.Size();
+                           });
+  }
+
+  // Upper bound on the number of items the compactors can hold, i.e. the sum
+  // of their max buffer sizes.
+  [[nodiscard]] uint64_t BufferCapacity() const {
+    return std::accumulate(compactors_.begin(), compactors_.end(),
+                           static_cast<uint64_t>(0),
+                           [](uint64_t sum, const Compactor<T> &compactor) {
+                             return sum + compactor.max_buffer_size;
+                           });
+  }
+
+  // Bytes held by the sketch, per level and in total, including heap bytes
+  // owned by the items (see HeapBytes). Kept up to date as items come and
+  // go, so this costs O(levels) rather than a walk over every item. Heap
+  // sizes are what the items had when they entered the sketch.
+  [[nodiscard]] SketchMemoryUsage MemoryUsage() const {
+    SketchMemoryUsage usage;
+    usage.overhead_bytes =
+        sizeof(*this) + compactors_.capacity() * sizeof(Compactor<T>);
+    usage.staging_bytes =
+        staging_.capacity() * sizeof(T) + staging_payload_bytes_;
+    usage.view_bytes = view_bytes_;
+    usage.total_bytes =
+        usage.overhead_bytes + usage.staging_bytes + usage.view_bytes;
+    for (const auto &compactor : compactors_) {
+      usage.levels.push_back(compactor.MemoryUsage());
+      usage.total_bytes += usage.levels.back().Total();
+    }
+    return usage;
+  }
+
+  // Moves levels min_level and up into packed storage (delta + bit packing,
+  // see PackedSortedLevel), typically 2-4x smaller for timestamps or
+  // latencies. Level 0 takes every insert and is best left unpacked. A
+  // packed level is unpacked the next time it is written to, so call this
+  // when the sketch goes idle or after a burst of inserts. Integral T only.
+  void Pack(const uint64_t min_level = 1) {
+    static_assert(std::is_integral_v<T>, "only integer sketches can pack");
+    for (uint64_t h = min_level; h < compactors_.size(); ++h) {
+      compactors_[h].Pack();
+    }
+  }
+
+  // Number of compactions so far, summed over levels. Merge() ors the
+  // schedules together, so after a merge this is approximate.
+  [[nodiscard]] uint64_t Compactions() const {
+    return std::accumulate(compactors_.begin(), compactors_.end(),
+                           static_cast<uint64_t>(0),
+                           [](uint64_t sum, const Compactor<T> &compactor) {
+                             return sum + compactor.C;
+                           });
+  }
+
   void Print() const {
     fmt::print("Sketch n {} k {} H {}\n", options_.n, options_.k, H_);
     std::for_each(
@@ -141,9 +578,141 @@ public:
   }
 
 private:
+  // Index of the first item whose cumulative weight reaches rank (in [0, 1])
+  // of the total weight.
+  [[nodiscard]] uint64_t QuantileIndex(double rank) const {
+    const uint64_t index =
+        BranchlessLowerBound(cumulative_weights_.data(),
+                             cumulative_weights_.size(), rank * total_weight_);
+    return std::min<uint64_t>(index, items_.size() - 1);
+  }
+
+  void SortLevels() {
+    for (auto &compactor : compactors_) {
+      compactor.Sort();
+    }
+  }
+
+  // Weight of the items less than item. Levels must be sorted.
+  [[nodiscard]] double LiveRank(const T &item) const {
+    double rank = static_cast<double>(
+        std::count_if(staging_.begin(), staging_.end(),
+                      [&item](const T &staged) { return staged < item; }));
+    for (const auto &compactor : compactors_) {
+      rank += std::pow(2, compactor.h) * compactor.LowerBound(item);
+    }
+    return rank;
+  }
+
+  // Sorted items [first, last) of one run, each of the given weight.
+  struct LiveRange {
+    const T *first;
+    const T *last;
+    double weight;
+  };
+
+  // Smallest item x such that the items <= x across ranges weigh at least
+  // target, as GetQuantile() finds it in the sorted view, or the largest
+  // item if they never do. Within one sorted range the items that qualify
+  // form a suffix, found by binary search with one upper bound per range
+  // for each probe; the answer is the least of those first qualifiers.
+  // Each range is only searched below the best answer so far. Costs
+  // O((ranges * log(items))^2) comparisons and moves nothing.
+  static const T &WeightedSelect(const std::vector<LiveRange> &ranges,
+                                 const double target) {
+    const auto weight_at_most = [&ranges](const T &x) {
+      double weight = 0;
+      for (const auto &range : ranges) {
+        weight += range.weight *
+                  (std::upper_bound(range.first, range.last, x) - range.first);
+      }
+      return weight;
+    };
+    const T *best = nullptr;
+    const T *largest = nullptr;
+    for (const auto &range : ranges) {
+      if (range.first == range.last) {
+        continue;
+      }
+      if (largest == nullptr || *largest < range.last[-1]) {
+        largest = range.last - 1;
+      }
+      const T *last = best == nullptr
+                          ? range.last
+                          : std::lower_bound(range.first, range.last, *best);
+      const T *found = std::partition_point(
+          range.first, last,
+          [&](const T &x) { return weight_at_most(x) < target; });
+      if (found != last) {
+        best = found;
+      }
+    }
+    assert(largest != nullptr);
+    return best != nullptr ? *best : *largest;
+  }
+
+  // Sorts the staged items and appends them to level 0 as one run.
+  void FlushStaging() {
+    if (staging_.empty()) {
+      return;
+    }
+    SortBatch(staging_.data(), staging_.size());
+    std::vector<T> output_stream;
+    compactors_[0].InsertRun(staging_.data(),
+                             staging_.data() + staging_.size(), output_stream);
+    staging_.clear();
+    staging_payload_bytes_ = 0;
+    if (!output_stream.empty()) {
+      Promote(output_stream, 1);
+    }
+  }
+
+  // Compaction survivors come out of the level below as sorted runs, so they
+  // are appended to level h in bulk rather than inserted one at a time.
+  void Promote(const std::vector<T> &items, const uint64_t h) {
+    EnsureLevel(h);
+
+    std::vector<T> output_stream;
+    compactors_[h].InsertRuns(items.data(), items.data() + items.size(),
+                              output_stream);
+    if (!output_stream.empty()) {
+      Promote(output_stream, h + 1);
+    }
+  }
+
+  void EnsureLevel(const uint64_t h) {
+    while (H_ < h) {
+      fmt::print("Sketch H {} < intended h {}, creating new compactor\n", H_,
+                 h);
+      ++H_;
+      compactors_.push_back(MakeCompactor(H_));
+    }
+  }
+
+  Compactor<T> MakeCompactor(const uint64_t h) const {
+    const uint64_t k = h == 0 ? options_.k * options_.level0_k_multiplier
+                              : options_.k;
+    const uint64_t level_n = h < 64 ? options_.n >> h : 0;
+    const uint64_t n = options_.sizing == BufferSizing::kLevelScaled
+                           ? std::max<uint64_t>(level_n, 1)
+                           : options_.n;
+    return Compactor<T>(k, n, h);
+  }
+
   const RelativeErrorQuantilesSketchOptions options_;
   uint64_t H_;
   std::vector<Compactor<T>> compactors_;
-  std::vector<WeightedElement> weighted_elements_;
+  std::vector<T> staging_;
+  uint64_t staging_payload_bytes_ = 0;
+  // Sorted view built by Close(): items and their inclusive cumulative
+  // weights.
+  std::vector<T> items_;
+  std::vector<double> cumulative_weights_;
   double total_weight_;
+  uint64_t view_bytes_ = 0;
+  uint64_t version_ = 0;
+  QueryCache<int, std::vector<Quantile>> quantiles_cache_;
+  QueryCache<double, T> live_quantile_cache_;
+  QueryCache<T, double> live_rank_cache_;
+  QueryCache<std::vector<T>, std::vector<double>> live_cdf_cache_;
 };
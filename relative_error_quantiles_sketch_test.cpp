@@ -0,0 +1,406 @@
+#include "relative_error_quantiles_sketch.h"
+#include <gtest/gtest.h>
+
+#include <random>
+
+TEST(RelativeErrorQuantilesSketchTest, UniformSizing) {
+  RelativeErrorQuantilesSketchOptions options = {.n = 1 << 16, .k = 16};
+  RelativeErrorQuantilesSketch<int> sketch(options);
+  for (int i = 0; i < (1 << 16); ++i) {
+    sketch.Insert(i, 0);
+  }
+  // Every level is sized for the whole stream: 2 * 16 * log2(2^16 / 16).
+  ASSERT_EQ(sketch.BufferCapacity(), (sketch.Depth() + 1) * 384);
+}
+
+TEST(RelativeErrorQuantilesSketchTest, LevelScaledSizing) {
+  RelativeErrorQuantilesSketchOptions uniform_options = {.n = 1 << 16,
+                                                         .k = 16};
+  RelativeErrorQuantilesSketchOptions scaled_options = {
+      .n = 1 << 16, .k = 16, .sizing = BufferSizing::kLevelScaled};
+  RelativeErrorQuantilesSketchOptions wide_options = {
+      .n = 1 << 16,
+      .k = 16,
+      .sizing = BufferSizing::kLevelScaled,
+      .level0_k_multiplier = 4};
+  RelativeErrorQuantilesSketch<int> uniform(uniform_options);
+  RelativeErrorQuantilesSketch<int> scaled(scaled_options);
+  RelativeErrorQuantilesSketch<int> wide(wide_options);
+  for (int i = 0; i < (1 << 16); ++i) {
+    uniform.Insert(i, 0);
+    scaled.Insert(i, 0);
+    wide.Insert(i, 0);
+  }
+  ASSERT_LT(scaled.BufferCapacity(), uniform.BufferCapacity());
+
+  // Compaction preserves weight, so every sketch still accounts for every
+  // inserted item.
+  uniform.Close();
+  scaled.Close();
+  wide.Close();
+  ASSERT_EQ(uniform.TotalWeight(), 1 << 16);
+  ASSERT_EQ(scaled.TotalWeight(), 1 << 16);
+  ASSERT_EQ(wide.TotalWeight(), 1 << 16);
+}
+
+TEST(RelativeErrorQuantilesSketchTest, StagingBuffer) {
+  RelativeErrorQuantilesSketchOptions options = {
+      .n = 1 << 16, .k = 16, .staging_size = 64};
+  RelativeErrorQuantilesSketch<int> sketch(options);
+  std::mt19937 gen(3);
+  for (int i = 0; i < (1 << 16) + 7; ++i) {
+    sketch.Insert(static_cast<int>(gen() % 100000), 0);
+  }
+  // Close flushes the partially filled staging buffer.
+  sketch.Close();
+  ASSERT_EQ(sketch.TotalWeight(), (1 << 16) + 7);
+}
+
+TEST(RelativeErrorQuantilesSketchTest, ExactQueries) {
+  // The stream fits in level 0, so every query is exact.
+  RelativeErrorQuantilesSketchOptions options = {.n = 1 << 16, .k = 16};
+  RelativeErrorQuantilesSketch<int> sketch(options);
+  for (int i = 100; i >= 1; --i) {
+    sketch.Insert(i, 0);
+  }
+  sketch.Close();
+  ASSERT_EQ(sketch.TotalWeight(), 100);
+  ASSERT_EQ(sketch.EstimateRank(1), 0);
+  ASSERT_EQ(sketch.EstimateRank(51), 50);
+  ASSERT_EQ(sketch.EstimateRank(1000), 100);
+  ASSERT_EQ(sketch.GetQuantile(0.0), 1);
+  ASSERT_EQ(sketch.GetQuantile(0.5), 50);
+  ASSERT_EQ(sketch.GetQuantile(1.0), 100);
+
+  const auto quantiles = sketch.Quantiles(4);
+  ASSERT_EQ(quantiles.size(), 4);
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_EQ(quantiles[i].quantile, i + 1);
+    ASSERT_EQ(quantiles[i].item, 25 * (i + 1));
+    ASSERT_EQ(quantiles[i].cumulative_weight, 25 * (i + 1));
+  }
+}
+
+TEST(RelativeErrorQuantilesSketchTest, Merge) {
+  RelativeErrorQuantilesSketchOptions options = {.n = 1 << 16, .k = 16};
+  RelativeErrorQuantilesSketch<int> evens(options);
+  RelativeErrorQuantilesSketch<int> odds(options);
+  for (int i = 0; i < (1 << 15); ++i) {
+    evens.Insert(2 * i, 0);
+    odds.Insert(2 * i + 1, 0);
+  }
+  evens.Merge(odds);
+  evens.Close();
+  ASSERT_EQ(evens.TotalWeight(), 1 << 16);
+  ASSERT_EQ(evens.GetQuantile(0.0), 0);
+  ASSERT_EQ(evens.EstimateRank(10), 10);
+}
+
+TEST(RelativeErrorQuantilesSketchTest, PackUpperLevels) {
+  RelativeErrorQuantilesSketchOptions options = {.n = 1 << 16, .k = 16};
+  RelativeErrorQuantilesSketch<int64_t> sketch(options);
+  for (int64_t i = 0; i < (1 << 16); ++i) {
+    sketch.Insert(i * 1000 - 12345, 0);
+  }
+  RelativeErrorQuantilesSketch<int64_t> packed = sketch;
+  packed.Pack();
+  ASSERT_EQ(packed.RetainedItems(), sketch.RetainedItems());
+
+  // The view is built from the decoded levels.
+  sketch.Close();
+  packed.Close();
+  ASSERT_EQ(packed.Items(), sketch.Items());
+  ASSERT_EQ(packed.CumulativeWeights(), sketch.CumulativeWeights());
+
+  // Writes unpack the levels they touch; merges decode the source.
+  RelativeErrorQuantilesSketch<int64_t> merged(options);
+  merged.Merge(packed);
+  for (int64_t i = 0; i < (1 << 16); ++i) {
+    packed.Insert(i, 0);
+  }
+  packed.Close();
+  merged.Close();
+  ASSERT_EQ(packed.TotalWeight(), 1 << 17);
+  ASSERT_EQ(merged.TotalWeight(), 1 << 16);
+}
+
+TEST(RelativeErrorQuantilesSketchTest, PackEmptyLevel) {
+  // Level 0 is still empty while items are staged; packing and then writing
+  // to it must not leave a run boundary behind.
+  RelativeErrorQuantilesSketchOptions options = {
+      .n = 1 << 16, .k = 16, .staging_size = 8};
+  RelativeErrorQuantilesSketch<int64_t> sketch(options);
+  for (int64_t i = 0; i < 3; ++i) {
+    sketch.Insert(i, 0);
+  }
+  sketch.Pack(0);
+  for (int64_t i = 3; i < 100; ++i) {
+    sketch.Insert(i, 0);
+  }
+  // The ascending flushes coalesce into one run.
+  ASSERT_EQ(sketch.Compactors()[0].run_ends.size(), 1);
+  sketch.Close();
+  ASSERT_EQ(sketch.TotalWeight(), 100);
+  ASSERT_EQ(sketch.EstimateRank(50), 50);
+}
+
+TEST(RelativeErrorQuantilesSketchTest, ParallelMerge) {
+  RelativeErrorQuantilesSketchOptions options = {.n = 1 << 18, .k = 16};
+  RelativeErrorQuantilesSketch<std::string> left(options);
+  RelativeErrorQuantilesSketch<std::string> right(options);
+  for (int i = 0; i < (1 << 17); ++i) {
+    left.Insert(fmt::format("key-{:07}", 2 * i), 0);
+    right.Insert(fmt::format("key-{:07}", 2 * i + 1), 0);
+  }
+  ThreadPool pool(4);
+  left.Merge(right, pool);
+  // Merging into an empty sketch copies every level as is.
+  RelativeErrorQuantilesSketch<std::string> copy(options);
+  copy.Merge(right, pool);
+  left.Close();
+  copy.Close();
+  right.Close();
+  ASSERT_EQ(left.TotalWeight(), 1 << 18);
+  ASSERT_EQ(left.GetQuantile(0.0), "key-0000000");
+  ASSERT_EQ(copy.Items(), right.Items());
+  ASSERT_EQ(copy.CumulativeWeights(), right.CumulativeWeights());
+  const double median = std::stod(left.GetQuantile(0.5).substr(4));
+  ASSERT_NEAR(median / (1 << 18), 0.5, 0.05);
+}
+
+TEST(RelativeErrorQuantilesSketchTest, LiveQuantile) {
+  RelativeErrorQuantilesSketchOptions exact_options = {.n = 1 << 16, .k = 16};
+  RelativeErrorQuantilesSketch<int> exact(exact_options);
+  for (int i = 100; i >= 1; --i) {
+    exact.Insert(i, 0);
+  }
+  ASSERT_EQ(exact.GetLiveQuantile(0.0), 1);
+  ASSERT_EQ(exact.GetLiveQuantile(0.5), 50);
+  ASSERT_EQ(exact.GetLiveQuantile(1.0), 100);
+
+  RelativeErrorQuantilesSketch<int> empty(exact_options);
+  ASSERT_THROW((void)empty.GetLiveQuantile(0.5), std::out_of_range);
+
+  // With compacted levels and staged items, the live answer is the one the
+  // sorted view gives for the same items.
+  RelativeErrorQuantilesSketchOptions options = {
+      .n = 1 << 16, .k = 16, .staging_size = 64};
+  RelativeErrorQuantilesSketch<int> sketch(options);
+  std::mt19937 gen(5);
+  for (int i = 0; i < (1 << 16) + 13; ++i) {
+    sketch.Insert(static_cast<int>(gen() % 1000), 0);
+  }
+  for (const double rank : {0.0, 0.01, 0.25, 0.5, 0.9, 0.99, 1.0}) {
+    const int live = sketch.GetLiveQuantile(rank);
+    RelativeErrorQuantilesSketch<int> closed = sketch;
+    closed.Close();
+    ASSERT_EQ(live, closed.GetQuantile(rank)) << rank;
+  }
+
+  // The sketch keeps working after live queries.
+  for (int i = 0; i < (1 << 16); ++i) {
+    sketch.Insert(static_cast<int>(gen() % 1000), 0);
+  }
+  sketch.Close();
+  ASSERT_EQ(sketch.TotalWeight(), (1 << 17) + 13);
+}
+
+TEST(RelativeErrorQuantilesSketchTest, LiveQuantileKeepsLevelState) {
+  RelativeErrorQuantilesSketchOptions options = {
+      .n = 1 << 16, .k = 16, .staging_size = 64};
+  RelativeErrorQuantilesSketch<int64_t> sketch(options);
+  std::mt19937 gen(11);
+  for (int i = 0; i < (1 << 15) + 200; ++i) {
+    sketch.Insert(static_cast<int64_t>(gen() % 1000), 0);
+  }
+  sketch.Pack(2);
+  std::vector<std::vector<uint64_t>> run_ends;
+  std::vector<bool> packed;
+  for (const auto &compactor : sketch.Compactors()) {
+    run_ends.push_back(compactor.run_ends);
+    packed.push_back(compactor.is_packed);
+  }
+  // Level 1 holds several promoted runs and level 2 and up are packed.
+  ASSERT_GT(run_ends[1].size(), 1);
+  ASSERT_TRUE(packed[2]);
+
+  RelativeErrorQuantilesSketch<int64_t> closed = sketch;
+  closed.Close();
+  for (const double rank : {0.0, 0.1, 0.5, 0.99, 1.0}) {
+    ASSERT_EQ(sketch.GetLiveQuantile(rank), closed.GetQuantile(rank)) << rank;
+  }
+  for (uint64_t h = 0; h < run_ends.size(); ++h) {
+    ASSERT_EQ(sketch.Compactors()[h].run_ends, run_ends[h]) << h;
+    ASSERT_EQ(sketch.Compactors()[h].is_packed, packed[h]) << h;
+  }
+}
+
+TEST(RelativeErrorQuantilesSketchTest, LiveRank) {
+  RelativeErrorQuantilesSketchOptions options = {
+      .n = 1 << 16, .k = 16, .staging_size = 64};
+  RelativeErrorQuantilesSketch<int64_t> sketch(options);
+  std::mt19937 gen(7);
+  for (int i = 0; i < (1 << 16) + 13; ++i) {
+    sketch.Insert(static_cast<int64_t>(gen() % 1000), 0);
+  }
+  // Packed levels are searched without unpacking.
+  sketch.Pack();
+  const std::vector<int64_t> splits = {-1, 0, 250, 500, 999, 1000};
+  const std::vector<double> cdf = sketch.LiveCdf(splits);
+  ASSERT_TRUE(sketch.Compactors()[1].is_packed);
+
+  RelativeErrorQuantilesSketch<int64_t> closed = sketch;
+  closed.Close();
+  ASSERT_EQ(cdf.size(), splits.size() + 1);
+  for (size_t i = 0; i < splits.size(); ++i) {
+    const double rank = closed.EstimateRank(splits[i]);
+    ASSERT_EQ(sketch.EstimateLiveRank(splits[i]), rank) << splits[i];
+    ASSERT_DOUBLE_EQ(cdf[i], rank / closed.TotalWeight()) << splits[i];
+  }
+  ASSERT_EQ(cdf.back(), 1.0);
+}
+
+TEST(RelativeErrorQuantilesSketchTest, LiveRankWithEmptyLevel) {
+  // Every item is still staged, so the query sorts an empty level 0 that the
+  // next staging flush then appends to.
+  RelativeErrorQuantilesSketchOptions options = {
+      .n = 1 << 16, .k = 16, .staging_size = 8};
+  RelativeErrorQuantilesSketch<int> sketch(options);
+  for (int i = 0; i < 3; ++i) {
+    sketch.Insert(i, 0);
+  }
+  ASSERT_EQ(sketch.EstimateLiveRank(2), 2);
+  for (int i = 3; i < 100; ++i) {
+    sketch.Insert(i, 0);
+  }
+  ASSERT_EQ(sketch.EstimateLiveRank(50), 50);
+  sketch.Close();
+  ASSERT_EQ(sketch.TotalWeight(), 100);
+  ASSERT_EQ(sketch.EstimateRank(50), 50);
+}
+
+TEST(RelativeErrorQuantilesSketchTest, QueryCache) {
+  // Large enough that nothing compacts and answers are exact.
+  RelativeErrorQuantilesSketchOptions options = {
+      .n = 1 << 16, .k = 1024, .staging_size = 64, .query_cache_size = 4};
+  RelativeErrorQuantilesSketch<int> sketch(options);
+  for (int i = 0; i < 1000; ++i) {
+    sketch.Insert(i, 0);
+  }
+  const uint64_t version = sketch.Version();
+  const double rank = sketch.EstimateLiveRank(500);
+  const std::vector<double> cdf = sketch.LiveCdf({100, 900});
+  const int median = sketch.GetLiveQuantile(0.5);
+  // Queries do not change the sketch and repeat their answers.
+  ASSERT_EQ(sketch.Version(), version);
+  ASSERT_EQ(sketch.EstimateLiveRank(500), rank);
+  ASSERT_EQ(sketch.LiveCdf({100, 900}), cdf);
+  ASSERT_EQ(sketch.GetLiveQuantile(0.5), median);
+
+  // Inserts invalidate cached answers.
+  for (int i = 0; i < 1000; ++i) {
+    sketch.Insert(-1, 0);
+  }
+  ASSERT_GT(sketch.Version(), version);
+  ASSERT_EQ(sketch.EstimateLiveRank(500), rank + 1000);
+  ASSERT_EQ(sketch.GetLiveQuantile(0.5), -1);
+
+  sketch.Close();
+  const auto quantiles = sketch.Quantiles(4);
+  ASSERT_EQ(sketch.Quantiles(4).back().item, quantiles.back().item);
+  ASSERT_EQ(quantiles.back().item, 999);
+}
+
+TEST(RelativeErrorQuantilesSketchTest, QuantileRefs) {
+  RelativeErrorQuantilesSketchOptions options = {.n = 1 << 16, .k = 16};
+  RelativeErrorQuantilesSketch<std::string> sketch(options);
+  for (int i = 0; i < (1 << 14); ++i) {
+    sketch.Insert(fmt::format("key-{:05}", i), 0);
+  }
+  sketch.Close();
+  const std::string &median = sketch.QuantileItem(0.5);
+  ASSERT_EQ(median, sketch.GetQuantile(0.5));
+  ASSERT_GE(&median, sketch.Items().data());
+  ASSERT_LT(&median, sketch.Items().data() + sketch.Items().size());
+
+  const auto quantiles = sketch.Quantiles(10);
+  std::vector<RelativeErrorQuantilesSketch<std::string>::QuantileRef> refs;
+  sketch.QuantileRefs(10, refs);
+  ASSERT_EQ(refs.size(), quantiles.size());
+  for (size_t i = 0; i < refs.size(); ++i) {
+    ASSERT_EQ(refs[i].quantile, quantiles[i].quantile);
+    ASSERT_EQ(*refs[i].item, quantiles[i].item);
+    ASSERT_EQ(refs[i].item, &sketch.Items()[refs[i].index]);
+    ASSERT_EQ(refs[i].cumulative_weight, quantiles[i].cumulative_weight);
+  }
+  // Polling again reuses the vector.
+  const auto *data = refs.data();
+  sketch.QuantileRefs(10, refs);
+  ASSERT_EQ(refs.data(), data);
+}
+
+TEST(RelativeErrorQuantilesSketchTest, Downsample) {
+  RelativeErrorQuantilesSketchOptions options = {.n = 1 << 18, .k = 16};
+  RelativeErrorQuantilesSketch<int> sketch(options);
+  std::mt19937 gen(11);
+  for (int i = 0; i < (1 << 18); ++i) {
+    sketch.Insert(static_cast<int>(gen() % 100000), 0);
+  }
+  sketch.Close();
+  const auto &items = sketch.Items();
+  const auto &cumulative_weights = sketch.CumulativeWeights();
+  double max_item_weight = 0.0;
+  for (size_t i = 0; i < items.size(); ++i) {
+    max_item_weight = std::max(
+        max_item_weight,
+        cumulative_weights[i] - (i == 0 ? 0.0 : cumulative_weights[i - 1]));
+  }
+  for (const uint64_t m : {1, 10, 100, 1000}) {
+    const auto points = sketch.Downsample(m);
+    ASSERT_LE(points.size(), m);
+    ASSERT_EQ(points.back().item, items.back());
+    // The rank of every distinct view item, read off the points, is within
+    // the bound.
+    double total = 0.0;
+    size_t p = 0;
+    for (size_t i = 0; i < items.size(); ++i) {
+      while (p < points.size() && points[p].item < items[i]) {
+        total += points[p++].weight;
+      }
+      if (i > 0 && !(items[i - 1] < items[i])) {
+        continue;
+      }
+      const double view_rank = i == 0 ? 0.0 : cumulative_weights[i - 1];
+      ASSERT_LT(std::abs(total - view_rank),
+                sketch.TotalWeight() / m + max_item_weight)
+          << m << " " << i;
+    }
+    while (p < points.size()) {
+      total += points[p++].weight;
+    }
+    ASSERT_EQ(total, sketch.TotalWeight());
+  }
+  // Small views come back whole.
+  ASSERT_EQ(sketch.Downsample(items.size()).size(), items.size());
+}
+
+// Opt in for this key type, as a program with evenly spread keys would.
+template <> struct UseInterpolationSearch<uint32_t> : std::true_type {};
+
+TEST(RelativeErrorQuantilesSketchTest, InterpolationSearchRanks) {
+  RelativeErrorQuantilesSketchOptions options = {.n = 1 << 16, .k = 16};
+  RelativeErrorQuantilesSketch<uint32_t> interpolated(options);
+  std::mt19937 gen(17);
+  for (int i = 0; i < (1 << 16); ++i) {
+    interpolated.Insert(gen(), 0);
+  }
+  interpolated.Close();
+  const auto &items = interpolated.Items();
+  for (size_t i = 0; i < items.size(); i += 97) {
+    if (i > 0 && items[i - 1] == items[i]) {
+      continue;
+    }
+    ASSERT_EQ(interpolated.EstimateRank(items[i]),
+              i == 0 ? 0.0 : interpolated.CumulativeWeights()[i - 1]);
+  }
+}
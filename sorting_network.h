@@ -0,0 +1,49 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+
+// Batches up to this size are sorted with a sorting network when T is
+// arithmetic. Beyond it the O(n log^2 n) comparators cost more than the
+// branch mispredictions they save.
+constexpr uint64_t kMaxSortingNetworkSize = 256;
+
+template <typename T> inline void CompareExchange(T &a, T &b) {
+  // Written with min/max so the compiler emits conditional moves (or vector
+  // min/max) rather than branches.
+  const T lo = std::min(a, b);
+  const T hi = std::max(a, b);
+  a = lo;
+  b = hi;
+}
+
+// Batcher's odd-even merge sort. The comparator sequence depends only on
+// size, never on the data, so there is nothing for the branch predictor to
+// get wrong. size must be a power of two.
+template <typename T> void OddEvenMergeSort(T *data, const uint64_t size) {
+  for (uint64_t p = 1; p < size; p <<= 1) {
+    for (uint64_t k = p; k >= 1; k >>= 1) {
+      for (uint64_t j = k % p; j + k < size; j += 2 * k) {
+        const uint64_t count = std::min(k, size - j - k);
+        for (uint64_t i = 0; i < count; ++i) {
+          if ((i + j) / (2 * p) == (i + j + k) / (2 * p)) {
+            CompareExchange(data[i + j], data[i + j + k]);
+          }
+        }
+      }
+    }
+  }
+}
+
+// Sorts a small batch that is expected to be cache resident.
+template <typename T> void SortBatch(T *data, const uint64_t size) {
+  const bool power_of_two = size != 0 && (size & (size - 1)) == 0;
+  if constexpr (std::is_arithmetic_v<T>) {
+    if (power_of_two && size <= kMaxSortingNetworkSize) {
+      OddEvenMergeSort(data, size);
+      return;
+    }
+  }
+  std::sort(data, data + size);
+}
@@ -0,0 +1,32 @@
+#include "sorting_network.h"
+#include <gtest/gtest.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+TEST(SortingNetworkTest, SortsPowerOfTwoBatches) {
+  std::mt19937 gen(7);
+  for (uint64_t size = 1; size <= kMaxSortingNetworkSize; size <<= 1) {
+    for (int trial = 0; trial < 20; ++trial) {
+      std::vector<int> batch(size);
+      for (auto &item : batch) {
+        item = static_cast<int>(gen() % 64);
+      }
+      std::vector<int> expected = batch;
+      std::sort(expected.begin(), expected.end());
+      SortBatch(batch.data(), batch.size());
+      ASSERT_EQ(batch, expected);
+    }
+  }
+}
+
+TEST(SortingNetworkTest, SortsOtherBatches) {
+  std::vector<double> batch = {3.5, -1.0, 2.0, 0.0, 7.25};
+  SortBatch(batch.data(), batch.size());
+  ASSERT_EQ(batch, (std::vector<double>{-1.0, 0.0, 2.0, 3.5, 7.25}));
+
+  std::vector<std::string> strings = {"b", "c", "a", "d"};
+  SortBatch(strings.data(), strings.size());
+  ASSERT_EQ(strings, (std::vector<std::string>{"a", "b", "c", "d"}));
+}
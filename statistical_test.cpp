@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "relative_error_quantiles_sketch.h"
+#include "thread_pool.h"
+
+// Largest relative rank error of a closed sketch over probes taken at
+// every power of two rank and every percentile of sorted.
+double MaxRelativeError(const RelativeErrorQuantilesSketch<double> &sketch,
+                        const std::vector<double> &sorted) {
+  const auto &items = sketch.Items();
+  const auto &cumulative_weights = sketch.CumulativeWeights();
+  std::vector<uint64_t> positions;
+  for (uint64_t p = 1; p < sorted.size(); p *= 2) {
+    positions.push_back(p);
+  }
+  for (uint64_t q = 1; q < 100; ++q) {
+    positions.push_back(sorted.size() * q / 100);
+  }
+  double worst = 0.0;
+  for (const uint64_t position : positions) {
+    const double probe = sorted[position];
+    const double exact =
+        std::lower_bound(sorted.begin(), sorted.end(), probe) - sorted.begin();
+    const uint64_t index =
+        std::lower_bound(items.begin(), items.end(), probe) - items.begin();
+    const double estimate = index == 0 ? 0.0 : cumulative_weights[index - 1];
+    worst = std::max(worst, std::abs(estimate - exact) / std::max(exact, 1.0));
+  }
+  return worst;
+}
+
+enum class Distribution {
+  kUniform,
+  kAscending,
+  kDescending,
+  kLogNormal,
+  kFewDistinct,
+};
+
+std::vector<double> Stream(const Distribution distribution, const uint64_t n,
+                           std::mt19937_64 &gen) {
+  std::vector<double> stream(n);
+  std::lognormal_distribution<double> lognormal(0.0, 2.0);
+  for (uint64_t i = 0; i < n; ++i) {
+    switch (distribution) {
+    case Distribution::kUniform:
+      stream[i] = std::uniform_real_distribution<double>(0.0, 1.0)(gen);
+      break;
+    case Distribution::kAscending:
+      stream[i] = static_cast<double>(i);
+      break;
+    case Distribution::kDescending:
+      stream[i] = static_cast<double>(n - i);
+      break;
+    case Distribution::kLogNormal:
+      stream[i] = lognormal(gen);
+      break;
+    case Distribution::kFewDistinct:
+      stream[i] = static_cast<double>(gen() % 1000);
+      break;
+    }
+  }
+  return stream;
+}
+
+// Max relative error of one seeded trial. Half the trials build two sketches
+// over halves of the stream and merge them.
+double Trial(const Distribution distribution, const uint64_t k,
+             const uint64_t seed) {
+  SeedRandomBoolean(seed);
+  std::mt19937_64 gen(seed);
+  const uint64_t n = 1 << 14;
+  std::vector<double> stream = Stream(distribution, n, gen);
+  RelativeErrorQuantilesSketchOptions options = {.n = n, .k = k};
+  RelativeErrorQuantilesSketch<double> sketch(options);
+  if (seed % 2 == 0) {
+    sketch.InsertBatch(stream.begin(), stream.end());
+  } else {
+    RelativeErrorQuantilesSketch<double> other(options);
+    sketch.InsertBatch(stream.begin(), stream.begin() + n / 2);
+    other.InsertBatch(stream.begin() + n / 2, stream.end());
+    sketch.Merge(other);
+  }
+  sketch.Close();
+  std::sort(stream.begin(), stream.end());
+  return MaxRelativeError(sketch, stream);
+}
+
+// Empirical bounds: these are not derived from the paper's analysis, whose
+// constants are far looser, but measured on the trials below.
+//
+// Relative rank error checked for a sketch with section size k. No trial
+// has reached twice it.
+double Epsilon(const uint64_t k) { return 0.25 / static_cast<double>(k); }
+// Worst fraction of trials above Epsilon(k) seen in any one distribution:
+// 2/300 for k = 8 and 13/300 for k = 32, rounded up.
+double ObservedFailureRate(const uint64_t k) { return k <= 8 ? 0.01 : 0.05; }
+constexpr uint64_t kTrials = 300;
+// Failure fraction allowed per distribution: the observed rate plus three
+// binomial standard deviations for kTrials trials, so a change in the
+// compaction coin flips passes unless it makes the sketch worse.
+double AllowedFailureRate(const uint64_t k) {
+  const double p = ObservedFailureRate(k);
+  return p + 3 * std::sqrt(p * (1 - p) / kTrials);
+}
+
+// Seeded trials for every distribution and k, run in parallel. Each trial
+// reseeds its thread's compaction generator, so results do not depend on
+// scheduling. About 3,000 trials of 16K items.
+TEST(StatisticalTest, EmpiricalRelativeErrorBound) {
+  const std::vector<Distribution> distributions = {
+      Distribution::kUniform, Distribution::kAscending,
+      Distribution::kDescending, Distribution::kLogNormal,
+      Distribution::kFewDistinct};
+  const std::vector<uint64_t> ks = {8, 32};
+  const uint64_t configs = distributions.size() * ks.size();
+  std::vector<double> errors(configs * kTrials);
+  ThreadPool pool;
+  pool.ParallelFor(errors.size(), [&](const uint64_t i) {
+    const uint64_t config = i / kTrials;
+    errors[i] = Trial(distributions[config % distributions.size()],
+                      ks[config / distributions.size()], i);
+  });
+
+  for (uint64_t config = 0; config < configs; ++config) {
+    const uint64_t k = ks[config / distributions.size()];
+    SCOPED_TRACE(fmt::format("distribution {} k {}",
+                             static_cast<int>(
+                                 distributions[config % distributions.size()]),
+                             k));
+    const auto first = errors.begin() + config * kTrials;
+    const auto last = first + kTrials;
+    const double failures = std::count_if(
+        first, last, [&](const double error) { return error > Epsilon(k); });
+    EXPECT_LE(failures / kTrials, AllowedFailureRate(k));
+    EXPECT_LE(*std::max_element(first, last), 2 * Epsilon(k));
+  }
+}
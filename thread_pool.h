@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running submitted tasks in FIFO order.
+class ThreadPool {
+public:
+  // threads == 0 means one per hardware thread.
+  explicit ThreadPool(unsigned threads = 0) {
+    if (threads == 0) {
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned t = 0; t < threads; ++t) {
+      workers_.emplace_back([this] { Work(); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    available_.notify_all();
+    for (auto &worker : workers_) {
+      worker.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  [[nodiscard]] unsigned Size() const {
+    return static_cast<unsigned>(workers_.size());
+  }
+
+  void Submit(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.push_back(std::move(task));
+    }
+    available_.notify_one();
+  }
+
+  // Runs function(i) for every i in [0, count) on the pool and returns once
+  // all have finished. The calling thread runs tasks too, so this may be
+  // called from inside a pool task. Rethrows the first exception thrown.
+  void ParallelFor(const uint64_t count,
+                   const std::function<void(uint64_t)> &function) {
+    if (count == 0) {
+      return;
+    }
+    if (count == 1) {
+      function(0);
+      return;
+    }
+    std::mutex mutex;
+    std::condition_variable done;
+    uint64_t remaining = count;
+    std::exception_ptr error;
+    auto run = [&](const uint64_t i) {
+      try {
+        function(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--remaining == 0) {
+        done.notify_one();
+      }
+    };
+    for (uint64_t i = 1; i < count; ++i) {
+      Submit([&run, i] { run(i); });
+    }
+    run(0);
+    // Help with queued tasks (ours or anyone's) instead of blocking a
+    // thread that could be running them.
+    while (RunOne()) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (remaining == 0) {
+        break;
+      }
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return remaining == 0; });
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+
+private:
+  // Runs one queued task on the calling thread, if there is one.
+  bool RunOne() {
+    std::function<void()> task;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (tasks_.empty()) {
+        return false;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+    return true;
+  }
+
+  void Work() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        available_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+        if (tasks_.empty()) {
+          return;
+        }
+        task = std::move(tasks_.front());
+        tasks_.pop_front();
+      }
+      task();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable available_;
+  std::deque<std::function<void()>> tasks_;
+  bool stopping_ = false;
+  std::vector<std::thread> workers_;
+};
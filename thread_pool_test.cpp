@@ -0,0 +1,39 @@
+#include "thread_pool.h"
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+TEST(ThreadPoolTest, ParallelForRunsEveryIndexOnce) {
+  ThreadPool pool(3);
+  std::vector<std::atomic<int>> runs(1000);
+  pool.ParallelFor(runs.size(), [&](uint64_t i) { ++runs[i]; });
+  for (const auto &count : runs) {
+    ASSERT_EQ(count, 1);
+  }
+}
+
+TEST(ThreadPoolTest, NestedParallelFor) {
+  // A single worker must not deadlock when tasks wait on their own tasks.
+  ThreadPool pool(1);
+  std::atomic<int> total{0};
+  pool.ParallelFor(4, [&](uint64_t) {
+    pool.ParallelFor(4, [&](uint64_t) { ++total; });
+  });
+  ASSERT_EQ(total, 16);
+}
+
+TEST(ThreadPoolTest, RethrowsFirstError) {
+  ThreadPool pool(2);
+  std::atomic<int> finished{0};
+  ASSERT_THROW(pool.ParallelFor(10,
+                                [&](uint64_t i) {
+                                  if (i == 7) {
+                                    throw std::runtime_error("task 7");
+                                  }
+                                  ++finished;
+                                }),
+               std::runtime_error);
+  ASSERT_EQ(finished, 9);
+}
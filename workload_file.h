@@ -0,0 +1,296 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include "mapped_file.h"
+#include "relative_error_quantiles_sketch.h"
+
+// Binary capture of a key stream, for replaying production workloads into
+// benchmarks. All integers are little-endian.
+//
+//   header   magic "SQKEYS01", then WorkloadHeader fields below
+//   records  [uint64 timestamp if kWorkloadTimestamps]
+//            [uint32 length unless fixed_width != 0]
+//            key bytes (fixed_width bytes, or length bytes)
+//
+// Fixed width numeric captures without timestamps are a plain array of
+// values after the header, so they replay straight out of the mapping.
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "workload files are read as little-endian in place");
+
+constexpr char kWorkloadMagic[8] = {'S', 'Q', 'K', 'E', 'Y', 'S', '0', '1'};
+constexpr uint32_t kWorkloadTimestamps = 1;
+
+// What the key bytes hold, so tools can pick the sketch type to replay into.
+enum class WorkloadKeyType : uint32_t {
+  kBytes = 0,
+  kUint64 = 1,
+  kInt64 = 2,
+  kDouble = 3,
+};
+
+struct WorkloadHeader {
+  char magic[8];
+  uint32_t flags;
+  WorkloadKeyType key_type;
+  // Bytes per key, or 0 for length-prefixed keys.
+  uint32_t fixed_width;
+  uint32_t reserved;
+  uint64_t record_count;
+};
+static_assert(sizeof(WorkloadHeader) == 32);
+
+struct WorkloadFormat {
+  WorkloadKeyType key_type = WorkloadKeyType::kBytes;
+  uint32_t fixed_width = 0;
+  bool timestamps = false;
+};
+
+template <typename T> WorkloadKeyType WorkloadKeyTypeOf() {
+  if constexpr (std::is_same_v<T, uint64_t>) {
+    return WorkloadKeyType::kUint64;
+  } else if constexpr (std::is_same_v<T, int64_t>) {
+    return WorkloadKeyType::kInt64;
+  } else if constexpr (std::is_same_v<T, double>) {
+    return WorkloadKeyType::kDouble;
+  } else {
+    return WorkloadKeyType::kBytes;
+  }
+}
+
+// Appends records to a workload file through a large write buffer. The
+// record count in the header is filled in by Close(), which the destructor
+// calls if needed. Throws std::system_error on I/O errors and
+// std::invalid_argument for keys that do not fit the format.
+class WorkloadRecorder {
+public:
+  WorkloadRecorder(const std::string &path, const WorkloadFormat &format)
+      : format_(format) {
+    file_ = std::fopen(path.c_str(), "wb");
+    if (file_ == nullptr) {
+      throw std::system_error(errno, std::generic_category(), "open " + path);
+    }
+    buffer_.reserve(kBufferBytes);
+    WriteHeader();
+  }
+
+  ~WorkloadRecorder() {
+    if (file_ != nullptr) {
+      try {
+        Close();
+      } catch (...) {
+      }
+    }
+  }
+
+  WorkloadRecorder(const WorkloadRecorder &) = delete;
+  WorkloadRecorder &operator=(const WorkloadRecorder &) = delete;
+
+  void Record(const std::string_view key, const uint64_t timestamp = 0) {
+    if (format_.fixed_width != 0 && key.size() != format_.fixed_width) {
+      throw std::invalid_argument("key does not match the fixed width");
+    }
+    if (format_.fixed_width == 0 && key.size() > UINT32_MAX) {
+      throw std::invalid_argument("key longer than 4 GiB");
+    }
+    if (format_.timestamps) {
+      Append(&timestamp, sizeof(timestamp));
+    }
+    if (format_.fixed_width == 0) {
+      const uint32_t length = static_cast<uint32_t>(key.size());
+      Append(&length, sizeof(length));
+    }
+    Append(key.data(), key.size());
+    ++record_count_;
+  }
+
+  // Records a numeric key as its raw bytes. The format's fixed width must be
+  // sizeof(T).
+  template <typename T>
+  void RecordValue(const T &value, const uint64_t timestamp = 0) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    Record(std::string_view(reinterpret_cast<const char *>(&value),
+                            sizeof(value)),
+           timestamp);
+  }
+
+  [[nodiscard]] uint64_t RecordCount() const { return record_count_; }
+
+  // Flushes and writes the final header. Later calls do nothing.
+  void Close() {
+    if (file_ == nullptr) {
+      return;
+    }
+    Flush();
+    WriteHeader();
+    const int status = std::fclose(file_);
+    file_ = nullptr;
+    if (status != 0) {
+      throw std::system_error(errno, std::generic_category(), "close");
+    }
+  }
+
+private:
+  static constexpr uint64_t kBufferBytes = 4 << 20;
+
+  void Append(const void *data, const uint64_t size) {
+    if (buffer_.size() + size > kBufferBytes) {
+      Flush();
+    }
+    const char *bytes = static_cast<const char *>(data);
+    buffer_.insert(buffer_.end(), bytes, bytes + size);
+  }
+
+  void Flush() {
+    if (!buffer_.empty() &&
+        std::fwrite(buffer_.data(), 1, buffer_.size(), file_) !=
+            buffer_.size()) {
+      throw std::system_error(errno, std::generic_category(), "write");
+    }
+    buffer_.clear();
+  }
+
+  // Writes the header at the start of the file, leaving the write position
+  // at the end.
+  void WriteHeader() {
+    WorkloadHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, kWorkloadMagic, sizeof(header.magic));
+    header.flags = format_.timestamps ? kWorkloadTimestamps : 0;
+    header.key_type = format_.key_type;
+    header.fixed_width = format_.fixed_width;
+    header.record_count = record_count_;
+    if (std::fseek(file_, 0, SEEK_SET) != 0 ||
+        std::fwrite(&header, sizeof(header), 1, file_) != 1 ||
+        std::fseek(file_, 0, SEEK_END) != 0) {
+      throw std::system_error(errno, std::generic_category(), "write header");
+    }
+  }
+
+  const WorkloadFormat format_;
+  std::FILE *file_ = nullptr;
+  std::vector<char> buffer_;
+  uint64_t record_count_ = 0;
+};
+
+// Maps a workload file and replays it. Throws std::system_error if the file
+// cannot be mapped and std::runtime_error if it is not a valid capture.
+class WorkloadReplayer {
+public:
+  explicit WorkloadReplayer(const std::string &path) : file_(path) {
+    if (file_.size() < sizeof(WorkloadHeader)) {
+      throw std::runtime_error(path + " is too short for a workload file");
+    }
+    std::memcpy(&header_, file_.data(), sizeof(header_));
+    if (std::memcmp(header_.magic, kWorkloadMagic, sizeof(kWorkloadMagic)) !=
+        0) {
+      throw std::runtime_error(path + " is not a workload file");
+    }
+    file_.Advise(0, file_.size(), MADV_SEQUENTIAL);
+  }
+
+  [[nodiscard]] uint64_t RecordCount() const { return header_.record_count; }
+  [[nodiscard]] WorkloadKeyType KeyType() const { return header_.key_type; }
+  [[nodiscard]] uint32_t FixedWidth() const { return header_.fixed_width; }
+  [[nodiscard]] bool HasTimestamps() const {
+    return (header_.flags & kWorkloadTimestamps) != 0;
+  }
+
+  // Calls function(key, timestamp) for every record in order, with key
+  // pointing into the mapping. timestamp is 0 when the capture has none.
+  template <typename Function> void ForEach(Function &&function) const {
+    const char *position = file_.data() + sizeof(WorkloadHeader);
+    const char *end = file_.data() + file_.size();
+    const bool timestamps = HasTimestamps();
+    for (uint64_t r = 0; r < header_.record_count; ++r) {
+      uint64_t timestamp = 0;
+      if (timestamps) {
+        Read(position, end, &timestamp, sizeof(timestamp));
+      }
+      uint32_t length = header_.fixed_width;
+      if (length == 0) {
+        Read(position, end, &length, sizeof(length));
+      }
+      if (static_cast<uint64_t>(end - position) < length) {
+        throw std::runtime_error("workload file is truncated");
+      }
+      function(std::string_view(position, length), timestamp);
+      position += length;
+    }
+  }
+
+  // Inserts every key into sketch in batches of batch_size. The capture's
+  // key type must be the sketch's (see WorkloadKeyTypeOf()): uint64_t,
+  // int64_t and double sketches read fixed width values, and other key types
+  // are constructed from byte keys. A numeric capture without timestamps is
+  // inserted straight out of the mapping.
+  template <typename T>
+  void Replay(RelativeErrorQuantilesSketch<T> &sketch,
+              const uint64_t batch_size = 4096) const {
+    constexpr bool kNumeric = std::is_arithmetic_v<T>;
+    if (header_.key_type != WorkloadKeyTypeOf<T>() ||
+        (kNumeric && header_.key_type == WorkloadKeyType::kBytes)) {
+      throw std::runtime_error("workload keys do not match the sketch type");
+    }
+    if constexpr (kNumeric) {
+      if (header_.fixed_width != sizeof(T)) {
+        throw std::runtime_error("workload keys are not " +
+                                 std::to_string(sizeof(T)) + " bytes wide");
+      }
+      if (!HasTimestamps()) {
+        if (header_.record_count >
+            (file_.size() - sizeof(WorkloadHeader)) / sizeof(T)) {
+          throw std::runtime_error("workload file is truncated");
+        }
+        const T *values =
+            reinterpret_cast<const T *>(file_.data() + sizeof(WorkloadHeader));
+        sketch.InsertBatch(values, values + header_.record_count);
+        return;
+      }
+    }
+
+    using Batched =
+        std::conditional_t<std::is_arithmetic_v<T>, T, std::string_view>;
+    std::vector<Batched> batch;
+    batch.reserve(batch_size);
+    ForEach([&](const std::string_view key, uint64_t) {
+      if constexpr (std::is_arithmetic_v<T>) {
+        T value;
+        std::memcpy(&value, key.data(), sizeof(value));
+        batch.push_back(value);
+      } else {
+        batch.push_back(key);
+      }
+      if (batch.size() == batch_size) {
+        sketch.InsertBatch(batch.begin(), batch.end());
+        batch.clear();
+      }
+    });
+    sketch.InsertBatch(batch.begin(), batch.end());
+  }
+
+private:
+  static void Read(const char *&position, const char *end, void *out,
+                   const uint64_t size) {
+    if (static_cast<uint64_t>(end - position) < size) {
+      throw std::runtime_error("workload file is truncated");
+    }
+    std::memcpy(out, position, size);
+    position += size;
+  }
+
+  MappedFile file_;
+  WorkloadHeader header_;
+};
@@ -0,0 +1,118 @@
+#include "workload_file.h"
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+RelativeErrorQuantilesSketchOptions Options() {
+  return RelativeErrorQuantilesSketchOptions{.n = 1 << 20, .k = 64};
+}
+
+TEST(WorkloadFileTest, LengthPrefixedWithTimestamps) {
+  const std::string path = ::testing::TempDir() + "keys.sqk";
+  std::vector<std::string> keys;
+  {
+    WorkloadRecorder recorder(path, {.timestamps = true});
+    for (int i = 0; i < 10000; ++i) {
+      keys.push_back(fmt::format("key-{}", i * 7919 % 10000));
+      recorder.Record(keys.back(), 1000 + i);
+    }
+    recorder.Record("a");
+    keys.push_back("a");
+  }
+
+  const WorkloadReplayer replayer(path);
+  ASSERT_EQ(replayer.RecordCount(), keys.size());
+  ASSERT_EQ(replayer.KeyType(), WorkloadKeyType::kBytes);
+  ASSERT_TRUE(replayer.HasTimestamps());
+  uint64_t r = 0;
+  replayer.ForEach([&](std::string_view key, uint64_t timestamp) {
+    ASSERT_EQ(key, keys[r]);
+    ASSERT_EQ(timestamp, r < 10000 ? 1000 + r : 0);
+    ++r;
+  });
+  ASSERT_EQ(r, keys.size());
+
+  RelativeErrorQuantilesSketch<std::string> sketch(Options());
+  replayer.Replay(sketch, 100);
+  sketch.Close();
+  ASSERT_EQ(sketch.TotalWeight(), keys.size());
+  ASSERT_EQ(sketch.GetQuantile(0.0), "a");
+  std::remove(path.c_str());
+}
+
+TEST(WorkloadFileTest, FixedWidthValues) {
+  const std::string path = ::testing::TempDir() + "values.sqk";
+  const WorkloadFormat format = {.key_type = WorkloadKeyTypeOf<int64_t>(),
+                                 .fixed_width = sizeof(int64_t)};
+  {
+    WorkloadRecorder recorder(path, format);
+    for (int64_t i = 0; i < 100000; ++i) {
+      recorder.RecordValue(i * 48271 % 100000 - 50000);
+    }
+    ASSERT_THROW(recorder.Record("short"), std::invalid_argument);
+  }
+
+  const WorkloadReplayer replayer(path);
+  ASSERT_EQ(replayer.KeyType(), WorkloadKeyType::kInt64);
+  ASSERT_FALSE(replayer.HasTimestamps());
+  RelativeErrorQuantilesSketch<int64_t> sketch(Options());
+  replayer.Replay(sketch);
+  sketch.Close();
+  ASSERT_EQ(sketch.TotalWeight(), 100000);
+  ASSERT_EQ(sketch.GetQuantile(0.0), -50000);
+
+  RelativeErrorQuantilesSketch<int32_t> narrow(Options());
+  ASSERT_THROW(replayer.Replay(narrow), std::runtime_error);
+  // Same width, other key type.
+  RelativeErrorQuantilesSketch<double> doubles(Options());
+  ASSERT_THROW(replayer.Replay(doubles), std::runtime_error);
+  RelativeErrorQuantilesSketch<std::string> strings(Options());
+  ASSERT_THROW(replayer.Replay(strings), std::runtime_error);
+  std::remove(path.c_str());
+}
+
+TEST(WorkloadFileTest, CloseTwice) {
+  const std::string path = ::testing::TempDir() + "closed-twice.sqk";
+  {
+    WorkloadRecorder recorder(path, {});
+    recorder.Record("a");
+    recorder.Close();
+    recorder.Close();
+  }
+  const WorkloadReplayer replayer(path);
+  ASSERT_EQ(replayer.RecordCount(), 1);
+  std::remove(path.c_str());
+}
+
+TEST(WorkloadFileTest, RejectsOtherFiles) {
+  const std::string path = ::testing::TempDir() + "not-a-workload.sqk";
+  std::ofstream(path, std::ios::binary | std::ios::trunc)
+      << "timestamp,key\n1,a\n2,b\n3,c\n4,d\n5,e\n";
+  ASSERT_THROW(WorkloadReplayer replayer(path), std::runtime_error);
+  std::remove(path.c_str());
+}
+
+TEST(WorkloadFileTest, RejectsImpossibleRecordCount) {
+  const std::string path = ::testing::TempDir() + "huge-count.sqk";
+  {
+    WorkloadRecorder recorder(path, {.key_type = WorkloadKeyType::kUint64,
+                                     .fixed_width = sizeof(uint64_t)});
+    recorder.RecordValue(uint64_t{1});
+  }
+  // A count whose byte size wraps around 2^64 to fit the file.
+  const uint64_t record_count = (uint64_t{1} << 61) + 1;
+  {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(offsetof(WorkloadHeader, record_count));
+    file.write(reinterpret_cast<const char *>(&record_count),
+               sizeof(record_count));
+  }
+  const WorkloadReplayer replayer(path);
+  RelativeErrorQuantilesSketch<uint64_t> sketch(Options());
+  ASSERT_THROW(replayer.Replay(sketch), std::runtime_error);
+  std::remove(path.c_str());
+}